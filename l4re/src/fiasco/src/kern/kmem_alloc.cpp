@@ -6,6 +6,7 @@ INTERFACE:
 #include "spin_lock.h"
 #include "lock_guard.h"
 #include "initcalls.h"
+#include "types.h"
 
 class Buddy_alloc;
 class Mem_region_map_base;
@@ -21,12 +22,32 @@ class Kmem_alloc
 
 public:
   typedef Buddy_alloc Alloc;
+
+  /**
+   * Consumers of kernel memory accounted separately from the total.
+   */
+  enum Usage_type
+  {
+    Usage_mapdb,      ///< Mapping database: frame arrays, tree maps, mappings.
+    Usage_ptab,       ///< Page tables below the root, capability tables.
+    Usage_num_types
+  };
+
+  /// Current and maximum number of bytes in use.
+  struct Usage
+  {
+    Mword current;
+    Mword peak;
+  };
+
 private:
   typedef Spin_lock<> Lock;
   static Lock lock;
   static Alloc *a;
   static unsigned long _orig_free;
   static Kmem_alloc *_alloc;
+  static Usage _total;
+  static Usage _usage[Usage_num_types];
 };
 
 
@@ -56,6 +77,8 @@ public:
       return 0;
 
     q.release();
+    Kmem_alloc::account(Kmem_alloc::Usage_ptab,
+                        static_cast<long>(cxx::int_value<Bytes>(size)));
     return b;
   }
 
@@ -63,6 +86,8 @@ public:
   {
     _a->free(size, block);
     _q->free(size);
+    Kmem_alloc::account(Kmem_alloc::Usage_ptab,
+                        -static_cast<long>(cxx::int_value<Bytes>(size)));
   }
 
   template<typename V>
@@ -86,12 +111,15 @@ IMPLEMENTATION:
 #include "mem_region.h"
 #include "buddy_alloc.h"
 #include "panic.h"
+#include "warn.h"
 
 static Kmem_alloc::Alloc _a;
 Kmem_alloc::Alloc *Kmem_alloc::a = &_a;
 unsigned long Kmem_alloc::_orig_free;
 Kmem_alloc::Lock Kmem_alloc::lock;
 Kmem_alloc *Kmem_alloc::_alloc;
+Kmem_alloc::Usage Kmem_alloc::_total;
+Kmem_alloc::Usage Kmem_alloc::_usage[Usage_num_types];
 
 PUBLIC static inline NEEDS[<cassert>]
 Kmem_alloc *
@@ -172,6 +200,8 @@ Kmem_alloc::alloc(Bytes size)
   {
     auto guard = lock_guard(lock);
     ret = a->alloc(sz);
+    if (ret)
+      account_total(sz);
   }
 
   if (!ret)
@@ -180,8 +210,13 @@ Kmem_alloc::alloc(Bytes size)
 
       auto guard = lock_guard(lock);
       ret = a->alloc(sz);
+      if (ret)
+        account_total(sz);
     }
 
+  if (EXPECT_FALSE(!ret))
+    oom_report(sz);
+
   return ret;
 }
 
@@ -193,6 +228,95 @@ Kmem_alloc::free(Bytes size, void *page)
   assert(sz >= 8 /* NEW INTERFACE PARANOIA */);
   auto guard = lock_guard(lock);
   a->free(page, sz);
+  _total.current -= sz;
+}
+
+/**
+ * Raise a high-water mark.
+ */
+PRIVATE static inline NEEDS["atomic.h"]
+void
+Kmem_alloc::raise_peak(Mword *peak, Mword current)
+{
+  for (Mword p = access_once(peak); current > p; p = access_once(peak))
+    if (mp_cas(peak, p, current))
+      break;
+}
+
+/**
+ * Account an allocation to the total usage, must hold the lock.
+ */
+PRIVATE static inline
+void
+Kmem_alloc::account_total(size_t sz)
+{
+  _total.current += sz;
+  if (_total.current > _total.peak)
+    _total.peak = _total.current;
+}
+
+/**
+ * Account kernel memory to a consumer.
+ *
+ * \param type   Consumer of the memory.
+ * \param bytes  Number of allocated bytes, negative for freed bytes.
+ */
+PUBLIC static inline NEEDS["atomic.h", Kmem_alloc::raise_peak]
+void
+Kmem_alloc::account(Usage_type type, long bytes)
+{
+  Usage *u = &_usage[type];
+  atomic_mp_add(&u->current, static_cast<Mword>(bytes));
+  if (bytes > 0)
+    raise_peak(&u->peak, access_once(&u->current));
+}
+
+/**
+ * Get the kernel memory usage of a consumer.
+ */
+PUBLIC static inline
+Kmem_alloc::Usage
+Kmem_alloc::usage(Usage_type type)
+{ return _usage[type]; }
+
+/**
+ * Get the total kernel memory usage.
+ *
+ * \param[out] size  Size of the kernel memory, i.e. the sum of used and
+ *                   available bytes.
+ */
+PUBLIC static
+Kmem_alloc::Usage
+Kmem_alloc::usage_total(Mword *size)
+{
+  auto guard = lock_guard(lock);
+  *size = _total.current + a->avail();
+  return _total;
+}
+
+/**
+ * Report the first failed allocation together with the memory usage.
+ *
+ * Kernel memory exhaustion usually surfaces as an -L4_ENOMEM result of some
+ * later user-level operation. The report tells whether the kernel memory is
+ * too small for the workload and which consumer holds it.
+ */
+PRIVATE static
+void
+Kmem_alloc::oom_report(size_t sz)
+{
+  static bool reported;
+  if (reported)
+    return;
+
+  reported = true;
+
+  Mword size;
+  Usage total = usage_total(&size);
+  WARN("Kmem_alloc: out of kernel memory allocating %lu bytes: "
+       "%lu of %lu KB used (peak %lu KB), mapdb %lu KB, page tables %lu KB\n",
+       (unsigned long)sz, total.current / 1024, size / 1024, total.peak / 1024,
+       _usage[Usage_mapdb].current / 1024, _usage[Usage_ptab].current / 1024);
 }
 
 
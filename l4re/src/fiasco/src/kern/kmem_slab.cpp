@@ -269,4 +269,22 @@ Kmem_slab::reap_all (bool desperate)
   return freed;
 }
 
+/**
+ * Get a slab cache by its index in the list of all slab caches.
+ *
+ * \param idx  Index of the slab cache.
+ *
+ * \return The slab cache, or nullptr if `idx` is out of range.
+ */
+PUBLIC static
+Slab_cache *
+Kmem_slab::cache(unsigned idx)
+{
+  for (auto *alloc: reap_list)
+    if (!idx--)
+      return alloc;
+
+  return nullptr;
+}
+
 static Kmem_alloc_reaper kmem_slab_reaper(Kmem_slab::reap_all);
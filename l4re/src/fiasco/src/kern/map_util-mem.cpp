@@ -99,6 +99,54 @@ mem_fpage_unmap(Space *space, L4_fpage fp, L4_map_mask mask)
 
 
 
+/** Merge the page described by "fp_dst" with the page described by
+    "fp_src" if both have the same content.
+    Write access to the destination page is revoked from all address
+    spaces the page has been mapped into, so that the content cannot change
+    while it is compared. If the contents match, the source page is mapped
+    to the destination address without write access, which also flushes
+    all mappings of the previous destination page. Otherwise, the
+    destination page stays in place and may be mapped writable again.
+    The contents are accessed through the user-level addresses of the
+    pages, hence "space" must be the current address space.
+    @param space  address space that contains both pages
+    @param fp_src flexpage descriptor of the source page, its rights
+                  determine the rights of the merged mapping
+    @param fp_dst flexpage descriptor of the destination page
+    @return 0 on success, -L4_err::EFault if the contents differ, or
+            -L4_err::EInval if the flexpages do not describe single pages
+*/
+int __attribute__((nonnull(1)))
+mem_merge(Space *space, L4_fpage const &fp_src, L4_fpage const &fp_dst)
+{
+  if (EXPECT_FALSE(!fp_src.is_mempage() || !fp_dst.is_mempage()
+                   || fp_src.order() != Config::PAGE_SHIFT
+                   || fp_dst.order() != Config::PAGE_SHIFT))
+    return -L4_err::EInval;
+
+  Address src = cxx::int_value<Virt_addr>(fp_src.mem_address());
+  Address dst = cxx::int_value<Virt_addr>(fp_dst.mem_address());
+  if (EXPECT_FALSE(src == dst))
+    return -L4_err::EInval;
+
+  // freeze the destination page in all other address spaces
+  mem_fpage_unmap(space, L4_fpage::mem(dst, Config::PAGE_SHIFT,
+                                       L4_fpage::Rights::W()),
+                  L4_map_mask(0));
+
+  Mword const *s = reinterpret_cast<Mword const *>(src);
+  Mword const *d = reinterpret_cast<Mword const *>(dst);
+  for (unsigned i = 0; i < Config::PAGE_SIZE / sizeof(Mword); ++i)
+    if (space->peek_user(s + i) != space->peek_user(d + i))
+      return -L4_err::EFault;
+
+  L4_fpage ro = L4_fpage::mem(src, Config::PAGE_SHIFT,
+                              fp_src.rights() & L4_fpage::Rights::RX());
+  L4_error err = mem_map(space, ro, space, L4_fpage::all_spaces(),
+                         L4_msg_item::map(dst));
+  return err.ok() ? 0 : -L4_err::ENomem;
+}
+
 /** The mapping database.
     This is the system's instance of the mapping database.
  */
@@ -495,6 +495,35 @@ Treemap_ops::grant(Treemap *submap, Space *old_space,
 }
 
 
+/**
+ * Check whether a submap does not contain any mappings anymore.
+ *
+ * The caller holds the lock of the frame that contains the submap, so no
+ * new lookup can descend into the submap. The locks of the frames of the
+ * submap are taken to wait for lookups that descended before.
+ */
+PUBLIC
+bool
+Treemap_ops::is_empty(Treemap *submap) const
+{
+  auto const end = submap->_key_end;
+
+  // cheap pass first, most submaps still contain mappings
+  for (Page key = Page(0); key < end; ++key)
+    if (submap->frame(key)->has_mappings())
+      return false;
+
+  for (Page key = Page(0); key < end; ++key)
+    {
+      Physframe *f = submap->frame(key);
+      auto guard = lock_guard(f->lock);
+      if (f->has_mappings())
+        return false;
+    }
+
+  return true;
+}
+
 PUBLIC inline NEEDS["mapping_tree.h"]
 void
 Treemap_ops::flush(Treemap *submap,
@@ -560,6 +589,8 @@ Treemap::create(Order parent_page_shift, Space *owner_id,
     }
 
   quota.release();
+  Kmem_alloc::account(Kmem_alloc::Usage_mapdb,
+                      cxx::int_value<Bytes>(quota_size(key_end)));
   return new (m) Treemap(key_end, owner_id, page_offset, page_shift, shifts + 1,
                          shifts_num - 1, pf);
 }
@@ -572,7 +603,7 @@ Treemap::allocator()
 { return _treemap_allocator.slab(); }
 
 
-PUBLIC inline
+PUBLIC inline NEEDS["kmem_alloc.h"]
 void
 Treemap::operator delete (void *block)
 {
@@ -582,6 +613,8 @@ Treemap::operator delete (void *block)
   asm ("" : "=m"(t->_owner_id), "=m"(t->_key_end));
   allocator()->free(block);
   Mapping_tree::quota(id)->free(Treemap::quota_size(end));
+  Kmem_alloc::account(Kmem_alloc::Usage_mapdb,
+                      -long(cxx::int_value<Bytes>(Treemap::quota_size(end))));
 }
 
 PUBLIC inline NEEDS[<cassert>]
@@ -602,14 +635,46 @@ Treemap::_lookup(Physframe *f, Mapping_tree::Iterator m,
                  Frame *res, int *root_depth = 0, int *current_depth = 0)
 {
   auto subkey = cxx::get_lsb(key, _page_shift);
+
+  // Fast path for plain lookups: merging makes the same mappings (and the
+  // same submaps leading to them) to be looked up over and over again, so
+  // first try the entry through which the last lookup in this tree
+  // succeeded. The order of entries only matters for depth tracking.
+  Treemap *hint_sub = nullptr;
+  if (!current_depth)
+    {
+      Mapping_tree::Iterator h = f->tree()->lookup_hint();
+      if (*h)
+        {
+          if ((hint_sub = h->submap()))
+            {
+              if (hint_sub->lookup(subkey, spc, va, res))
+                return h;
+            }
+          else if (match(*h, spc, va))
+            {
+              res->set(h, this, f);
+              return h;
+            }
+        }
+    }
+
   for (; *m; ++m)
     {
       if (Treemap *sub = m->submap())
         {
+          // already searched via the hint
+          if (sub == hint_sub)
+            continue;
+
           // XXX Recursion.  The max. recursion depth should better be
           // limited!
           if (sub->lookup(subkey, spc, va, res))
-            return m;
+            {
+              if (!current_depth)
+                f->tree()->set_lookup_hint(m);
+              return m;
+            }
 
           continue;
         }
@@ -623,6 +688,8 @@ Treemap::_lookup(Physframe *f, Mapping_tree::Iterator m,
 
       if (match(*m, spc, va))
         {
+          if (!current_depth)
+            f->tree()->set_lookup_hint(m);
           res->set(m, this, f);
           return m;
         }
@@ -118,6 +118,12 @@ public:
 
 private:
   using Mappings = cxx::S_list<Mapping>;
+  using Internal = decltype(Mappings::__get_internal(Iterator()));
+
+  /// Entry through which the last lookup in this tree succeeded (a mapping
+  /// or a submap), or nullptr. Reset on every change to the tree, as it
+  /// refers to the link field of the preceding entry.
+  Internal _lookup_hint = nullptr;
 
 public:
   ~Mapping_tree() { assert(!front()); }
@@ -174,6 +180,7 @@ IMPLEMENTATION:
 #include "config.h"
 #include "globals.h"
 #include "kdb_ke.h"
+#include "kmem_alloc.h"
 #include "kmem_slab.h"
 #include "ram_quota.h"
 #include "space.h"
@@ -195,7 +202,10 @@ Mapping_tree::erase(Space *owner)
   if (!front())
     return;
 
+  _lookup_hint = nullptr;
+
   Ram_quota *q = quota(owner);
+  long freed = 0;
   for (Iterator d = begin(); *d;)
     {
       // space is nullptr if the Mapping references a submap and
@@ -210,9 +220,30 @@ Mapping_tree::erase(Space *owner)
       Mapping *m = *d;
       d = Mappings::erase(d);
       _mapping_allocator.q_del(q, m);
+      freed += sizeof(Mapping);
     }
+
+  Kmem_alloc::account(Kmem_alloc::Usage_mapdb, -freed);
 }
 
+/**
+ * Get the entry through which the last lookup in this tree succeeded.
+ *
+ * \return The entry, or end() if the tree changed since the last lookup.
+ */
+PUBLIC inline
+Mapping_tree::Iterator
+Mapping_tree::lookup_hint() const
+{ return _lookup_hint ? Mappings::__iter(_lookup_hint) : Iterator(); }
+
+/**
+ * Remember the entry through which a lookup in this tree succeeded.
+ */
+PUBLIC inline
+void
+Mapping_tree::set_lookup_hint(Iterator const &m)
+{ _lookup_hint = Mappings::__get_internal(m); }
+
 PUBLIC inline NEEDS[<cassert>]
 Treemap *
 Mapping_tree::find_submap(Const_iterator parent) const
@@ -239,6 +270,9 @@ Mapping_tree::allocate_submap(Ram_quota *payer, Iterator parent)
   if (!m)
     return end();
 
+  Kmem_alloc::account(Kmem_alloc::Usage_mapdb, sizeof(Mapping));
+  _lookup_hint = nullptr;
+
   if (*parent)
     {
       insert(m, parent);
@@ -262,6 +296,9 @@ Mapping_tree::allocate(Ram_quota *payer, Iterator parent)
   if (!m)
     return end();
 
+  Kmem_alloc::account(Kmem_alloc::Usage_mapdb, sizeof(Mapping));
+  _lookup_hint = nullptr;
+
   Iterator test = parent;
   if (*test)
     {
@@ -294,9 +331,12 @@ PUBLIC
 Mapping_tree::Iterator
 Mapping_tree::free_mapping(Ram_quota *q, Iterator m)
 {
+  _lookup_hint = nullptr;
+
   auto d = *m;
   m = Mappings::erase(m);
   _mapping_allocator.q_del(q, d);
+  Kmem_alloc::account(Kmem_alloc::Usage_mapdb, -long(sizeof(Mapping)));
   return m;
 }
 
@@ -322,11 +362,18 @@ Mapping_tree::flush(Iterator m, int p_depth, bool me_too,
               && submap_ops.is_partial(submap, offs_begin, offs_end))
             {
               submap_ops.flush(submap, offs_begin, offs_end);
-              ++m;
-              continue;
+
+              // Unmapping single pages of a large frame may leave an empty
+              // submap behind, which would keep its frame array until the
+              // whole frame is flushed. Drop it right away.
+              if (!submap_ops.is_empty(submap))
+                {
+                  ++m;
+                  continue;
+                }
             }
-          else
-            submap_ops.del(submap);
+
+          submap_ops.del(submap);
         }
       else    // Found a real mapping
         {
@@ -17,6 +17,7 @@ private:
   { Invalid = 1UL << ((sizeof(Mword) * 8) - 1) };
 
   Mword _max;
+  Mword _peak;
 };
 
 
@@ -44,14 +45,14 @@ Ram_quota::operator new (size_t, void *b) throw()
 
 PUBLIC
 Ram_quota::Ram_quota()
-  : _parent(0), _current(0), _max(0)
+  : _parent(0), _current(0), _max(0), _peak(0)
 {
   root = this;
 }
 
 PUBLIC
 Ram_quota::Ram_quota(Ram_quota *p, Mword max)
-  : _parent(p), _current(0), _max(max)
+  : _parent(p), _current(0), _max(max), _peak(0)
 {}
 
 
@@ -82,10 +83,32 @@ Ram_quota::alloc(Mword bytes)
         return false;
 
       if (mp_cas(&_current, o, n))
-        return true;
+        {
+          raise_peak(n);
+          return true;
+        }
     }
 }
 
+PRIVATE inline NEEDS["atomic.h"]
+void
+Ram_quota::raise_peak(Mword current)
+{
+  for (Mword p = access_once(&_peak); current > p; p = access_once(&_peak))
+    if (mp_cas(&_peak, p, current))
+      break;
+}
+
+/**
+ * Get the maximum number of bytes ever allocated from this quota.
+ *
+ * Unlimited quotas are not accounted, their peak is always 0.
+ */
+PUBLIC inline
+Mword
+Ram_quota::peak() const
+{ return _peak; }
+
 PUBLIC inline
 bool
 Ram_quota::alloc(Bytes size)
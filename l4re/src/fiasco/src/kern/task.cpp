@@ -31,6 +31,8 @@ public:
     Unmap         = 1,
     Cap_info      = 2,
     Add_ku_mem    = 3,
+    Merge         = 4,
+    Kmem_info     = 5,
     Ldt_set_x86   = 0x11,
     Vgicc_map_arm = 0x12,
   };
@@ -485,6 +487,128 @@ Task::sys_unmap(Syscall_frame *f, Utcb *utcb)
   return commit_result(0, words);
 }
 
+/**
+ * Merge pairs of pages of this task that have the same content.
+ *
+ * The message contains pairs of flexpages, each describing a source and a
+ * destination page (see mem_merge()). The pairs are processed in order until
+ * the first pair that cannot be merged. On return, the label of the tag
+ * contains the number of merged pairs and the first message word contains
+ * the error of the pair that could not be merged, if any.
+ */
+PRIVATE inline NOEXPORT
+L4_msg_tag
+Task::sys_merge(Syscall_frame *f, Utcb *utcb)
+{
+  unsigned words = f->tag().words();
+
+  // the page contents are compared through the current address space
+  if (EXPECT_FALSE(static_cast<Space *>(this) != ::current()->space()))
+    return commit_result(-L4_err::EInval);
+
+  if (EXPECT_FALSE(words < 2 || (words & 1)))
+    return commit_result(-L4_err::EInval);
+
+  unsigned merged = 0;
+  int err = 0;
+
+    {
+      Ref_ptr<Task> self(this);
+      Lock_guard<Lock> guard;
+
+      if (!guard.check_and_lock(&existence_lock))
+        return commit_error(utcb, L4_error::Not_existent);
+
+      cpu_lock.clear();
+
+      for (unsigned i = 2; i < words; i += 2, ++merged)
+        {
+          err = mem_merge(this, L4_fpage(utcb->values[i]),
+                          L4_fpage(utcb->values[i + 1]));
+          if (err < 0)
+            break;
+        }
+
+      cpu_lock.lock();
+    }
+
+  utcb->values[1] = err;
+  return commit_result(merged, 2);
+}
+
+/**
+ * Report the kernel memory usage.
+ *
+ * If the first message word is ~0, the reply contains the current usage,
+ * limit and high-water mark of the kernel memory quota of this task,
+ * followed by the current usage, high-water mark and size of the kernel
+ * memory, followed by the current usage and high-water mark of the mapping
+ * database and of page tables. Otherwise, the first message word is the
+ * index of a slab cache, and the reply contains its element size, slab size,
+ * number of allocated elements, current and maximum number of slabs and its
+ * name.
+ *
+ * The usage is that of the whole system, so the caller needs the S right on
+ * the task capability.
+ */
+PRIVATE inline NOEXPORT NEEDS["kmem_alloc.h", "kmem_slab.h"]
+L4_msg_tag
+Task::sys_kmem_info(L4_fpage::Rights rights, Syscall_frame *f, Utcb *utcb)
+{
+  if (EXPECT_FALSE(!(rights & L4_fpage::Rights::CS())))
+    return commit_result(-L4_err::EPerm);
+
+  if (EXPECT_FALSE(f->tag().words() < 2))
+    return commit_result(-L4_err::EInval);
+
+  Mword idx = access_once(&utcb->values[1]);
+  Mword *v = utcb->values;
+
+  if (idx == ~0UL)
+    {
+      Ram_quota const *q = ram_quota();
+      Mword size;
+      Kmem_alloc::Usage total = Kmem_alloc::usage_total(&size);
+      Kmem_alloc::Usage mapdb = Kmem_alloc::usage(Kmem_alloc::Usage_mapdb);
+      Kmem_alloc::Usage ptab = Kmem_alloc::usage(Kmem_alloc::Usage_ptab);
+
+      // unlimited quotas (e.g. the root quota) are not accounted, they draw
+      // from the kernel memory directly.
+      v[0] = q->unlimited() ? total.current : q->current();
+      v[1] = q->limit();
+      v[2] = q->unlimited() ? total.peak : q->peak();
+      v[3] = total.current;
+      v[4] = total.peak;
+      v[5] = size;
+      v[6] = mapdb.current;
+      v[7] = mapdb.peak;
+      v[8] = ptab.current;
+      v[9] = ptab.peak;
+      return commit_result(0, 10);
+    }
+
+  Slab_cache *c = Kmem_slab::cache(idx);
+  if (!c)
+    return commit_result(-L4_err::ENoent);
+
+  enum { Name_words = 16 / sizeof(Mword) };
+  Slab_cache::Usage u;
+  c->usage(&u);
+
+  v[0] = u.entry_size;
+  v[1] = u.slab_size;
+  v[2] = u.in_use;
+  v[3] = u.slabs;
+  v[4] = u.peak_slabs;
+
+  char *name = reinterpret_cast<char *>(&v[5]);
+  char const *n = c->name();
+  for (unsigned i = 0; i < Name_words * sizeof(Mword); ++i)
+    name[i] = *n ? *n++ : 0;
+
+  return commit_result(0, 5 + Name_words);
+}
+
 PRIVATE inline NOEXPORT
 L4_msg_tag
 Task::sys_cap_valid(Syscall_frame *, Utcb *utcb)
@@ -578,6 +702,12 @@ Task::invoke(L4_obj_ref, L4_fpage::Rights rights, Syscall_frame *f, Utcb *utcb)
     case Add_ku_mem:
       f->tag(sys_add_ku_mem(f, utcb));
       return;
+    case Merge:
+      f->tag(sys_merge(f, utcb));
+      return;
+    case Kmem_info:
+      f->tag(sys_kmem_info(rights, f, utcb));
+      return;
     default:
       L4_msg_tag tag = f->tag();
       if (invoke_arch(tag, utcb))
@@ -41,6 +41,16 @@ public:
   static constexpr unsigned entry_size(unsigned elem_size, unsigned alignment)
   { return (elem_size + alignment - 1) & ~(alignment - 1); }
 
+  /// Usage snapshot of a slab cache, see usage().
+  struct Usage
+  {
+    unsigned long slab_size;  ///< Size of a slab in bytes.
+    unsigned entry_size;      ///< Size of an element in bytes.
+    unsigned long in_use;     ///< Number of allocated elements.
+    unsigned slabs;           ///< Number of slabs (full, partial, empty).
+    unsigned peak_slabs;      ///< Maximum number of slabs ever held.
+  };
+
 protected:
   friend class Slab;
   friend class Slab_cache_tester;
@@ -62,12 +72,15 @@ private:
   typedef cxx::H_list<Slab> Slab_list;
   Slab_list _full;    ///< List of full slabs
   Slab_list _partial; ///< List of partially filled slabs
+  Slab_list _sparse;  ///< Partially filled slabs that are draining
   Slab_list _empty;   ///< List of empty slabs
 
 
   unsigned long _slab_size;
   unsigned _entry_size, _elem_num;
   unsigned _num_empty;
+  unsigned _num_slabs, _peak_slabs;
+  unsigned long _in_use;
   typedef Spin_lock<> Lock;
   Lock lock;
   char const *_name;
@@ -169,7 +182,7 @@ Slab_cache::Slab_cache(unsigned elem_size,
 				 unsigned long min_size,
 				 unsigned long max_size)
   : _entry_size(entry_size(elem_size, alignment)), _num_empty(0),
-    _name (name)
+    _num_slabs(0), _peak_slabs(0), _in_use(0), _name (name)
 {
   lock.init();
 
@@ -191,7 +204,7 @@ Slab_cache::Slab_cache(unsigned long slab_size,
 				 unsigned alignment,
 				 char const * name)
   : _slab_size(slab_size), _entry_size(entry_size(elem_size, alignment)),
-    _num_empty(0), _name (name)
+    _num_empty(0), _num_slabs(0), _peak_slabs(0), _in_use(0), _name (name)
 {
   lock.init();
   _elem_num = (_slab_size - sizeof(Slab)) / _entry_size;
@@ -219,6 +232,17 @@ Slab_cache::get_available_locked()
   if (s)
     return s;
 
+  // Fall back to sparse slabs before touching empty ones. Otherwise a
+  // workload that frees most of its objects keeps all of its slabs
+  // half-filled forever.
+  s = _sparse.front();
+  if (s)
+    {
+      _sparse.remove(s);
+      _partial.add(s);
+      return s;
+    }
+
   s = _empty.front();
   if (s)
     {
@@ -264,6 +288,8 @@ Slab_cache::alloc()	// request initialized member from cache
 
 	      _partial.add(new_slab);
 	      s = new_slab;
+	      if (++_num_slabs > _peak_slabs)
+	        _peak_slabs = _num_slabs;
 	    }
 	  else
 	    unused_block = m;
@@ -271,6 +297,7 @@ Slab_cache::alloc()	// request initialized member from cache
 
       ret = s->alloc();
       assert(ret);
+      ++_in_use;
 
       if (s->is_full())
 	{
@@ -316,12 +343,20 @@ Slab_cache::free(void *cache_entry) // return initialized member to cache
       bool was_full = s->is_full();
 
       s->free(cache_entry);
+      --_in_use;
 
       if (was_full)
 	{
 	  cxx::H_list<Slab>::remove(s);
 	  _partial.add(s);
 	}
+      else if (s->in_use() == _elem_num / 4 && _elem_num >= 4)
+	{
+	  // Stop allocating from slabs that fell below a quarter of their
+	  // capacity, so that they can drain and be returned to the system.
+	  cxx::H_list<Slab>::remove(s);
+	  _sparse.add(s);
+	}
       else if (s->is_empty())
 	{
 	  cxx::H_list<Slab>::remove(s);
@@ -331,7 +366,10 @@ Slab_cache::free(void *cache_entry) // return initialized member to cache
 	      ++_num_empty;
 	    }
 	  else
-	    to_free = s;
+	    {
+	      to_free = s;
+	      --_num_slabs;
+	    }
 	}
     }
 
@@ -369,6 +407,7 @@ Slab_cache::reap()		// request that cache returns memory to system
 	    break;
 
 	  cxx::H_list<Slab>::remove(s);
+	  --_num_slabs;
 	}
 
       // explicitly call destructor to delete s;
@@ -380,6 +419,28 @@ Slab_cache::reap()		// request that cache returns memory to system
   return sz;
 }
 
+/**
+ * Get a snapshot of the memory usage of this cache.
+ *
+ * \param[out] u  Usage of the cache.
+ */
+PUBLIC
+void
+Slab_cache::usage(Usage *u)
+{
+  auto guard = lock_guard(lock);
+  u->slab_size = _slab_size;
+  u->entry_size = _entry_size;
+  u->in_use = _in_use;
+  u->slabs = _num_slabs;
+  u->peak_slabs = _peak_slabs;
+}
+
+PUBLIC inline
+char const *
+Slab_cache::name() const
+{ return _name; }
+
 // Debugging output
 
 #include <cstdio>
@@ -420,6 +481,20 @@ Slab_cache::debug_dump()
 
   printf ("%u used, ", count);
 
+  count = 0;
+  for (Slab_list::Const_iterator s = _sparse.begin(); s != _sparse.end(); ++s)
+    {
+      if (s->is_full() || s->is_empty())
+	printf ("\n*** wrongly-enqueued sparse slab found\n");
+
+      count++;
+      total_elems += s->in_use();
+    }
+
+  total += count;
+
+  printf ("%u sparse, ", count);
+
   count = 0;
   for (Slab_list::Const_iterator s = _empty.begin(); s != _empty.end(); ++s)
     {
@@ -0,0 +1,151 @@
+/* SPDX-License-Identifier: GPL-2.0-only or License-Ref-kk-custom */
+
+INTERFACE:
+
+static char const __attribute__((unused)) *Mapdb_bench_group = "Mapdb_bench";
+
+//---------------------------------------------------------------------------
+IMPLEMENTATION:
+
+#include "utest_fw.h"
+#include "kmem_alloc.h"
+#include "mapdb.h"
+#include "ram_quota.h"
+#include "space.h"
+#include "timer.h"
+#include "common_test_mapdb.h"
+
+void
+init_unittest()
+{
+  Utest::wait_for_app_cpus();
+
+  Utest_fw::tap_log.start();
+
+  Mapdb_bench_test().test_mapdb_bench(100000);
+  Mapdb_bench_test().test_mapdb_bench(1000000);
+
+  Utest_fw::tap_log.finish();
+}
+
+/**
+ * Throughput of map, lookup and unmap operations on many 4K children of
+ * superpage frames.
+ *
+ * This is the pattern of a page-sharing server that maps single pages out of
+ * large sigma0 frames into a client: every superpage frame ends up with up to
+ * Pages_per_super children in a submap. The output is not compared against
+ * stored output, it is meant for comparing kernel versions.
+ */
+class Mapdb_bench_test : public Mapdb_test_base
+{
+  template <typename T> using Ptr = cxx::unique_ptr<T, Utest::Deleter<T>>;
+  using Space_ptr                 = Ptr<Test_space>;
+  using Test_s0_ptr               = Ptr<Test_s0_space>;
+  using Mapdb_ptr                 = Ptr<Mapdb>;
+
+  enum
+  {
+    Phys_bits = 42,
+    /// Guest-virtual base of the mappings in the client.
+    Client_base = _1G,
+  };
+
+private:
+  Test_fake_factory rq;
+  Test_s0_ptr sigma0 = Utest::kmem_create<Test_s0_space>(&rq);
+  Space_ptr client   = Utest::kmem_create<Test_space>(&rq, "client");
+  Mapdb_ptr mapdb;
+};
+
+PUBLIC
+Mapdb_bench_test::Mapdb_bench_test()
+{
+  static size_t pz[] = { O_1G - O_page, O_4M - O_page, O_2M - O_page, 0 };
+  mapdb = Utest::kmem_create<Mapdb>(&*sigma0,
+                                    Mapping::Order(Phys_bits - O_page),
+                                    pz, sizeof(pz) / sizeof(pz[0]));
+}
+
+/**
+ * Print the throughput of one benchmark phase.
+ */
+PRIVATE static
+void
+Mapdb_bench_test::report(char const *phase, unsigned long n, Unsigned64 us)
+{
+  printf("MDB bench: %-6s %8lu mappings in %10llu us (%llu ops/s)\n",
+         phase, n, us, us ? (n * 1000000ULL) / us : 0ULL);
+}
+
+/**
+ * Map, look up and unmap `num` single pages from sigma0 into the client.
+ *
+ * Stops early if the kernel memory is exhausted while inserting and runs the
+ * remaining phases on the mappings that were created.
+ */
+PUBLIC
+void
+Mapdb_bench_test::test_mapdb_bench(unsigned long num)
+{
+  Utest_fw::tap_log.new_test(Mapdb_bench_group, __func__,
+                             "0c6b3e2e-53a1-4b5e-9d2e-6f0ad47a1c93");
+
+  Mapdb &m = *mapdb;
+  Mapdb::Frame f;
+  Mapdb::Pcnt const page = Mem_space::to_pcnt(Mem_space::Page_order(O_page));
+  unsigned long n;
+  Unsigned64 start;
+
+  // Phase 1: look up the sigma0 frame and insert a 4K child into the client.
+  start = Timer::system_clock();
+  for (n = 0; n < num; ++n)
+    {
+      Address phys = n * S_page;
+      if (!m.lookup(&*sigma0, to_pfn(phys), to_pfn(phys), &f))
+        break;
+
+      Mapping *sub = m.insert(f, &*client, to_pfn(Client_base + phys),
+                              to_pfn(phys), page);
+      f.clear();
+      if (!sub)
+        break;
+    }
+  report("map", n, Timer::system_clock() - start);
+
+  UTEST_GT(Utest::Expect, n, 0UL, "Inserted mappings");
+  if (n < num)
+    printf("MDB bench: out of kernel memory after %lu of %lu mappings\n",
+           n, num);
+  num = n;
+
+  // Phase 2: look up every client mapping.
+  start = Timer::system_clock();
+  for (n = 0; n < num; ++n)
+    {
+      Address phys = n * S_page;
+      if (!m.lookup(&*client, to_pfn(Client_base + phys), to_pfn(phys), &f))
+        break;
+      f.clear();
+    }
+  report("lookup", n, Timer::system_clock() - start);
+  UTEST_EQ(Utest::Expect, n, num, "Found all mappings");
+
+  // Phase 3: unmap every client mapping, one page at a time.
+  start = Timer::system_clock();
+  for (n = 0; n < num; ++n)
+    {
+      Address phys = n * S_page;
+      Mapdb::Pfn va = to_pfn(Client_base + phys);
+      if (!m.lookup(&*client, va, to_pfn(phys), &f))
+        break;
+      m.flush(f, L4_map_mask::full(), va, va + page);
+      f.clear();
+    }
+  report("unmap", n, Timer::system_clock() - start);
+  UTEST_EQ(Utest::Expect, n, num, "Removed all mappings");
+
+  UTEST_FALSE(Utest::Expect,
+              m.lookup(&*client, to_pfn(Client_base), to_pfn(0), &f),
+              "Lookup of removed mapping fails");
+}
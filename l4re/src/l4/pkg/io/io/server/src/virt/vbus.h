@@ -155,6 +155,15 @@ public:
     return -L4_ENOSYS;
   }
 
+  int op_merge(L4Re::Dataspace::Rights,
+               L4Re::Dataspace::Offset,
+               L4::Ipc::Snd_fpage,
+               L4Re::Dataspace::Offset,
+               L4Re::Dataspace::Size)
+  {
+    return -L4_ENOSYS;
+  }
+
   int op_map(L4Re::Dataspace::Rights r,
              L4Re::Dataspace::Offset offset,
              L4Re::Dataspace::Map_addr spot,
@@ -27,6 +27,7 @@
 L4_RPC_DEF(L4Re::Dataspace::clear);
 L4_RPC_DEF(L4Re::Dataspace::allocate);
 L4_RPC_DEF(L4Re::Dataspace::copy_in);
+L4_RPC_DEF(L4Re::Dataspace::merge);
 L4_RPC_DEF(L4Re::Dataspace::info);
 
 namespace L4Re {
@@ -42,6 +43,10 @@ Dataspace::__map(Dataspace::Offset offset, unsigned char *size,
   L4::Ipc::Rcv_fpage r;
   r = L4::Ipc::Rcv_fpage::mem(base, *size, 0);
 
+  // tell the server the size of the receive window, see Snd_fpages
+  flags = (flags & ~F::Rcv_order_mask)
+          | Flags(l4_umword_t(*size) << F::Rcv_order_shift);
+
   L4::Ipc::Snd_fpage fp;
   long err = map_t::call(c(), offset, spot, flags, r, fp, l4_utcb());
   if (L4_UNLIKELY(err < 0))
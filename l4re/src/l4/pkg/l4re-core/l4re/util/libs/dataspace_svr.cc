@@ -101,6 +101,55 @@ Dataspace_svr::map(Dataspace::Offset offs,
   return L4_EOK;
 }
 
+void
+Dataspace_svr::map_around(Dataspace::Offset offs,
+                          Dataspace::Map_addr hot_spot,
+                          Dataspace::Flags flags,
+                          unsigned rcv_order,
+                          L4Re::Snd_fpages &memory)
+{
+  unsigned long pages = fault_around_pages();
+
+  // without the receive window, the kernel might wrap neighbours around
+  if (pages < 2 || !rcv_order || !memory.is_valid())
+    return;
+
+  offs     = l4_trunc_page(offs);
+  hot_spot = l4_trunc_page(hot_spot);
+
+  Dataspace::Map_addr window = Dataspace::Map_addr(1) << rcv_order;
+  if (hot_spot >= window)
+    return;
+
+  // naturally aligned block around the hot spot, within the receive window
+  Dataspace::Map_addr start
+    = hot_spot - ((hot_spot >> L4_PAGESHIFT) % pages) * L4_PAGESIZE;
+  Dataspace::Map_addr end
+    = cxx::min(start + pages * L4_PAGESIZE, window);
+
+  // part of the block that is covered by the mapped flexpage already
+  Dataspace::Map_addr mapped = l4_trunc_size(hot_spot, memory.order());
+  Dataspace::Map_addr mapped_end
+    = mapped + (Dataspace::Map_addr(1) << memory.order());
+
+  for (Dataspace::Map_addr spot = start; spot < end; spot += L4_PAGESIZE)
+    {
+      if (spot >= mapped && spot < mapped_end)
+        continue;
+
+      // offsets in front of the dataspace wrap around and fail the check
+      Dataspace::Offset o = offs + spot - hot_spot;
+      if (!check_limit(o) || !map_around_hook(o, flags))
+        continue;
+
+      l4_fpage_t fpage = l4_fpage(_ds_start + o, L4_PAGESHIFT,
+                                  flags.fpage_rights());
+      if (!memory.add(L4::Ipc::Snd_fpage(fpage, spot, _map_flags,
+                                         _cache_flags)))
+        break;
+    }
+}
+
 long
 Dataspace_svr::clear(l4_addr_t offs, unsigned long ds_size) const noexcept
 {
@@ -102,6 +102,12 @@ L4Re_app_model::prog_attach_ds(l4_addr_t addr, unsigned long size,
   if (Global::l4re_aux->ldr_flags & L4RE_AUX_LDR_FLAG_EAGER_MAP)
     flags |= L4Re::Rm::F::Eager_map;
 
+  // Read-only segments are attached directly from the binary, mapping them
+  // in one go saves a page fault round trip for every page of the segment.
+  if ((Global::l4re_aux->ldr_flags & L4RE_AUX_LDR_FLAG_EAGER_MAP_RO)
+      && !(flags & L4Re::Rm::F::W))
+    flags |= L4Re::Rm::F::Eager_map;
+
   chksys(_rm->attach(&addr, size, flags,
                      L4::Ipc::make_cap(ds, flags.cap_rights()),
                      offset), what);
@@ -21,7 +21,7 @@
 #include "globals.h"
 
 enum {
-  Heap_max = L4_PAGESIZE * 256,
+  Heap_max = L4_PAGESIZE * 64,
 };
 
 extern char __executable_start[];
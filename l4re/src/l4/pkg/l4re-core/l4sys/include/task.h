@@ -140,6 +140,136 @@ l4_task_unmap_batch_u(l4_cap_idx_t task, l4_fpage_t const *fpages,
                       unsigned num_fpages, l4_umword_t map_mask,
                       l4_utcb_t *u) L4_NOTHROW;
 
+/**
+ * Merge pairs of memory pages with the same content.
+ * \ingroup l4_task_api
+ *
+ * \param task       Capability selector of the task that contains the pages.
+ *                   Must be the task of the calling thread.
+ * \param fpages     An array of flexpages. Consecutive items form pairs of a
+ *                   source page and a destination page, each of
+ *                   #L4_PAGESIZE.
+ * \param num_pairs  Number of pairs in the `fpages` array.
+ *
+ * \return Syscall return tag. On success, the label contains the number of
+ *         merged pairs. If this number is smaller than `num_pairs`, message
+ *         register 1 contains the error of the first pair that could not be
+ *         merged (-L4_EFAULT if the contents of the pages differ).
+ *
+ * For every pair, write access to the destination page is revoked from all
+ * tasks the page has been mapped to. Then, the contents of both pages are
+ * compared. If they match, the source page is mapped to the address of the
+ * destination page with the rights of the source flexpage, but without write
+ * access. This also flushes all mappings of the previous destination page.
+ * The pairs are processed in order until the first pair that cannot be
+ * merged.
+ *
+ * \pre The caller needs to take care that `num_pairs` is not bigger
+ *      than (L4_UTCB_GENERIC_DATA_SIZE - 2) / 2.
+ */
+L4_INLINE l4_msgtag_t
+l4_task_merge_batch(l4_cap_idx_t task, l4_fpage_t const *fpages,
+                    unsigned num_pairs) L4_NOTHROW;
+
+/**
+ * \internal
+ */
+L4_INLINE l4_msgtag_t
+l4_task_merge_batch_u(l4_cap_idx_t task, l4_fpage_t const *fpages,
+                      unsigned num_pairs, l4_utcb_t *u) L4_NOTHROW;
+
+/**
+ * Defined if the kernel memory usage can be queried, see l4_task_kmem_info().
+ * \ingroup l4_task_api
+ */
+#define L4_TASK_HAVE_KMEM_INFO 1
+
+/**
+ * Kernel memory usage, see l4_task_kmem_info().
+ * \ingroup l4_task_api
+ *
+ * All values are in bytes. A limit of 0 denotes an unlimited quota, whose
+ * usage and high-water mark are those of the kernel memory.
+ */
+typedef struct l4_task_kmem_info_t
+{
+  l4_umword_t quota_current;  /**< Allocated from the quota of the task. */
+  l4_umword_t quota_limit;    /**< Limit of the quota of the task. */
+  l4_umword_t quota_peak;     /**< High-water mark of the quota. */
+  l4_umword_t kmem_current;   /**< Allocated kernel memory. */
+  l4_umword_t kmem_peak;      /**< High-water mark of the kernel memory. */
+  l4_umword_t kmem_size;      /**< Size of the kernel memory. */
+  l4_umword_t mapdb_current;  /**< Used by the mapping database. */
+  l4_umword_t mapdb_peak;     /**< High-water mark of the mapping database. */
+  l4_umword_t ptab_current;   /**< Used by page and capability tables. */
+  l4_umword_t ptab_peak;      /**< High-water mark of the tables. */
+} l4_task_kmem_info_t;
+
+/**
+ * Usage of a kernel slab cache, see l4_task_kmem_cache().
+ * \ingroup l4_task_api
+ */
+typedef struct l4_task_kmem_cache_t
+{
+  l4_umword_t entry_size;     /**< Size of an element in bytes. */
+  l4_umword_t slab_size;      /**< Size of a slab in bytes. */
+  l4_umword_t in_use;         /**< Number of allocated elements. */
+  l4_umword_t slabs;          /**< Number of slabs. */
+  l4_umword_t peak_slabs;     /**< Maximum number of slabs ever held. */
+  char name[16];              /**< Name, not necessarily 0-terminated. */
+} l4_task_kmem_cache_t;
+
+/**
+ * Get the kernel memory usage.
+ * \ingroup l4_task_api
+ *
+ * \param      task  Capability selector of the task whose kernel memory
+ *                   quota is reported, needs the S right.
+ * \param[out] info  Kernel memory usage.
+ *
+ * \return Syscall return tag. The error -L4_EPERM denotes a missing S right.
+ *
+ * Besides the quota of the task, i.e. the quota of the factory the task was
+ * created from, the kernel reports its total memory usage and the memory
+ * used by the mapping database and by page tables, together with the
+ * high-water marks since boot.
+ */
+L4_INLINE l4_msgtag_t
+l4_task_kmem_info(l4_cap_idx_t task, l4_task_kmem_info_t *info) L4_NOTHROW;
+
+/**
+ * \internal
+ */
+L4_INLINE l4_msgtag_t
+l4_task_kmem_info_u(l4_cap_idx_t task, l4_task_kmem_info_t *info,
+                    l4_utcb_t *u) L4_NOTHROW;
+
+/**
+ * Get the usage of a kernel slab cache.
+ * \ingroup l4_task_api
+ *
+ * \param      task   Capability selector of a task, needs the S right.
+ * \param      idx    Index of the slab cache.
+ * \param[out] cache  Usage of the slab cache.
+ *
+ * \return Syscall return tag. The error -L4_ENOENT denotes that `idx` is
+ *         not smaller than the number of slab caches, -L4_EPERM denotes a
+ *         missing S right.
+ *
+ * The kernel allocates its objects from slab caches, one per object size
+ * (named "fixed size") and some for specific objects.
+ */
+L4_INLINE l4_msgtag_t
+l4_task_kmem_cache(l4_cap_idx_t task, unsigned idx,
+                   l4_task_kmem_cache_t *cache) L4_NOTHROW;
+
+/**
+ * \internal
+ */
+L4_INLINE l4_msgtag_t
+l4_task_kmem_cache_u(l4_cap_idx_t task, unsigned idx,
+                     l4_task_kmem_cache_t *cache, l4_utcb_t *u) L4_NOTHROW;
+
 /**
  * Release capability and delete object.
  * \ingroup l4_task_api
@@ -272,6 +402,8 @@ enum L4_task_ops
   L4_TASK_UNMAP_OP         = 1UL,    /**< Unmap */
   L4_TASK_CAP_INFO_OP      = 2UL,    /**< Cap info */
   L4_TASK_ADD_KU_MEM_OP    = 3UL,    /**< Add kernel-user memory */
+  L4_TASK_MERGE_OP         = 4UL,    /**< Merge pages */
+  L4_TASK_KMEM_INFO_OP     = 5UL,    /**< Kernel memory usage */
   L4_TASK_LDT_SET_X86_OP   = 0x11UL, /**< x86: LDT set */
   L4_TASK_MAP_VGICC_ARM_OP = 0x12UL, /**< Arm: Map virtual GICC area */
 };
@@ -318,6 +450,45 @@ l4_task_unmap_batch_u(l4_cap_idx_t task, l4_fpage_t const *fpages,
   return l4_ipc_call(task, u, l4_msgtag(L4_PROTO_TASK, 2 + num_fpages, 0, 0), L4_IPC_NEVER);
 }
 
+L4_INLINE l4_msgtag_t
+l4_task_merge_batch_u(l4_cap_idx_t task, l4_fpage_t const *fpages,
+                      unsigned num_pairs, l4_utcb_t *u) L4_NOTHROW
+{
+  l4_msg_regs_t *v = l4_utcb_mr_u(u);
+  v->mr[0] = L4_TASK_MERGE_OP;
+  v->mr[1] = 0;
+  __builtin_memcpy(&v->mr[2], fpages, 2 * num_pairs * sizeof(l4_fpage_t));
+  return l4_ipc_call(task, u, l4_msgtag(L4_PROTO_TASK, 2 + 2 * num_pairs, 0, 0), L4_IPC_NEVER);
+}
+
+L4_INLINE l4_msgtag_t
+l4_task_kmem_info_u(l4_cap_idx_t task, l4_task_kmem_info_t *info,
+                    l4_utcb_t *u) L4_NOTHROW
+{
+  l4_msg_regs_t *v = l4_utcb_mr_u(u);
+  l4_msgtag_t tag;
+  v->mr[0] = L4_TASK_KMEM_INFO_OP;
+  v->mr[1] = ~0UL;
+  tag = l4_ipc_call(task, u, l4_msgtag(L4_PROTO_TASK, 2, 0, 0), L4_IPC_NEVER);
+  if (!l4_error_u(tag, u))
+    __builtin_memcpy(info, &v->mr[0], sizeof(*info));
+  return tag;
+}
+
+L4_INLINE l4_msgtag_t
+l4_task_kmem_cache_u(l4_cap_idx_t task, unsigned idx,
+                     l4_task_kmem_cache_t *cache, l4_utcb_t *u) L4_NOTHROW
+{
+  l4_msg_regs_t *v = l4_utcb_mr_u(u);
+  l4_msgtag_t tag;
+  v->mr[0] = L4_TASK_KMEM_INFO_OP;
+  v->mr[1] = idx;
+  tag = l4_ipc_call(task, u, l4_msgtag(L4_PROTO_TASK, 2, 0, 0), L4_IPC_NEVER);
+  if (!l4_error_u(tag, u))
+    __builtin_memcpy(cache, &v->mr[0], sizeof(*cache));
+  return tag;
+}
+
 L4_INLINE l4_msgtag_t
 l4_task_cap_valid_u(l4_cap_idx_t task, l4_cap_idx_t cap, l4_utcb_t *u) L4_NOTHROW
 {
@@ -372,6 +543,26 @@ l4_task_unmap_batch(l4_cap_idx_t task, l4_fpage_t const *fpages,
                                l4_utcb());
 }
 
+L4_INLINE l4_msgtag_t
+l4_task_merge_batch(l4_cap_idx_t task, l4_fpage_t const *fpages,
+                    unsigned num_pairs) L4_NOTHROW
+{
+  return l4_task_merge_batch_u(task, fpages, num_pairs, l4_utcb());
+}
+
+L4_INLINE l4_msgtag_t
+l4_task_kmem_info(l4_cap_idx_t task, l4_task_kmem_info_t *info) L4_NOTHROW
+{
+  return l4_task_kmem_info_u(task, info, l4_utcb());
+}
+
+L4_INLINE l4_msgtag_t
+l4_task_kmem_cache(l4_cap_idx_t task, unsigned idx,
+                   l4_task_kmem_cache_t *cache) L4_NOTHROW
+{
+  return l4_task_kmem_cache_u(task, idx, cache, l4_utcb());
+}
+
 L4_INLINE l4_msgtag_t
 l4_task_delete_obj_u(l4_cap_idx_t task, l4_cap_idx_t obj,
                      l4_utcb_t *u) L4_NOTHROW
@@ -118,6 +118,32 @@ Moe::Dataspace::op_copy_in(L4Re::Dataspace::Rights obj,
   return L4_EOK;
 }
 
+long
+Moe::Dataspace::op_merge(L4Re::Dataspace::Rights obj,
+                         L4Re::Dataspace::Offset dst_offs,
+                         L4::Ipc::Snd_fpage const &src_cap,
+                         L4Re::Dataspace::Offset src_offs,
+                         L4Re::Dataspace::Size sz)
+{
+  Moe::Dataspace *src = 0;
+
+  if (src_cap.id_received())
+    src = dynamic_cast<Moe::Dataspace*>(object_pool.find(src_cap.data()));
+
+  if (!map_flags(obj).w())
+    return -L4_EACCESS;
+
+  if (!src)
+    return -L4_EINVAL;
+
+  // the source pages get mapped to the destination, so the caller must be
+  // allowed to read them.
+  if (!(src_cap.data() & L4_CAP_FPAGE_R))
+    return -L4_EACCESS;
+
+  return merge(dst_offs, src, src_offs, sz);
+}
+
 long
 Moe::Dataspace::clear(l4_addr_t offs, unsigned long size) const throw()
 {
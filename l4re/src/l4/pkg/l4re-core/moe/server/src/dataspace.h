@@ -107,6 +107,18 @@ public:
   virtual bool is_static() const throw() = 0;
   virtual long clear(unsigned long offs, unsigned long size) const throw();
 
+  /**
+   * Share the pages of a range with a range of another dataspace, where
+   * their contents match.
+   *
+   * \return Number of bytes that share pages, or a negative error code.
+   * \see L4Re::Dataspace::merge
+   */
+  virtual long merge(l4_addr_t /*dst_offs*/, Dataspace const * /*src*/,
+                     l4_addr_t /*src_offs*/,
+                     unsigned long /*size*/) const throw()
+  { return -L4_ENOSYS; }
+
 protected:
   void size(unsigned long size) throw() { _size = size; }
 
@@ -143,6 +155,12 @@ public:
                   L4Re::Dataspace::Offset src_offs,
                   L4Re::Dataspace::Size sz);
 
+  long op_merge(L4Re::Dataspace::Rights rights,
+                L4Re::Dataspace::Offset dst_offs,
+                L4::Ipc::Snd_fpage const &src_cap,
+                L4Re::Dataspace::Offset src_offs,
+                L4Re::Dataspace::Size sz);
+
   long op_info(L4Re::Dataspace::Rights rights, L4Re::Dataspace::Stats &s)
   {
     s.size = size();
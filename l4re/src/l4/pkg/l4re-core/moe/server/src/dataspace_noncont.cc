@@ -165,6 +165,56 @@ Moe::Dataspace_noncont::clear(unsigned long offs, unsigned long size) const thro
   return 0;
 }
 
+long
+Moe::Dataspace_noncont::merge(l4_addr_t dst_offs, Dataspace const *src_ds,
+                              l4_addr_t src_offs,
+                              unsigned long size) const throw()
+{
+  Dataspace_noncont const *src
+    = dynamic_cast<Dataspace_noncont const *>(src_ds);
+  if (!src)
+    return -L4_EINVAL;
+
+  unsigned long pg_sz = page_size();
+  if (src->page_size() != pg_sz
+      || ((dst_offs | src_offs | size) & (pg_sz - 1)))
+    return -L4_EINVAL;
+
+  if (!check_range(dst_offs, size) || !src->check_range(src_offs, size))
+    return -L4_ERANGE;
+
+  unsigned long merged = 0;
+  for (; size; size -= pg_sz, dst_offs += pg_sz, src_offs += pg_sz)
+    {
+      Page &dst_p = page(dst_offs);
+      Page &src_p = src->page(src_offs);
+      if (!dst_p.valid() || !src_p.valid())
+        continue;
+
+      if (*dst_p == *src_p)
+        {
+          merged += pg_sz;
+          continue;
+        }
+
+      // Revoke write access first, so that the contents cannot change
+      // until both offsets refer to the same page. Writers just fault in
+      // again if the contents differ.
+      unmap_page(dst_p, true);
+      src->unmap_page(src_p, true);
+      if (memcmp(*dst_p, *src_p, pg_sz))
+        continue;
+
+      Moe::Pages::share(*src_p);
+      src_p.set(*src_p, src_p.flags() | Page_cow);
+      free_page(dst_p);
+      dst_p.set(*src_p, Page_cow);
+      merged += pg_sz;
+    }
+
+  return merged;
+}
+
 namespace {
   class Mem_one_page : public Moe::Dataspace_noncont
   {
@@ -94,6 +94,8 @@ private:
 
 public:
   long clear(unsigned long offs, unsigned long size) const throw() override;
+  long merge(l4_addr_t dst_offs, Dataspace const *src, l4_addr_t src_offs,
+             unsigned long size) const throw() override;
 
   static Dataspace_noncont *create(Q_alloc *q, unsigned long size,
                                    Flags flags = L4Re::Dataspace::F::RWX);
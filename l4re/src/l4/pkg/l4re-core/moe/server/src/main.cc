@@ -366,6 +366,7 @@ static Dbg_bits const ldr_flag_bits[] =
    {"eager_map",    L4RE_AUX_LDR_FLAG_EAGER_MAP},
    {"all_segs_cow", L4RE_AUX_LDR_FLAG_ALL_SEGS_COW},
    {"pinned_segs",  L4RE_AUX_LDR_FLAG_PINNED_SEGS},
+   {"eager_map_ro", L4RE_AUX_LDR_FLAG_EAGER_MAP_RO},
    {"exit",  0x10},
    {0, 0}};
 
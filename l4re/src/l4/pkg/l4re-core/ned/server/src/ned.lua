@@ -52,6 +52,7 @@ Ldr_flags = {
   eager_map    = 0x1, -- L4RE_AUX_LDR_FLAG_EAGER_MAP
   all_segs_cow = 0x2, -- L4RE_AUX_LDR_FLAG_ALL_SEGS_COW
   pinned_segs  = 0x4, -- L4RE_AUX_LDR_FLAG_PINNED_SEGS
+  eager_map_ro = 0x8, -- L4RE_AUX_LDR_FLAG_EAGER_MAP_RO
 }
 
 -- Flags for dataspace allocation via user_factory
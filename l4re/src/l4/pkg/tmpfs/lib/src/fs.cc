@@ -12,6 +12,10 @@
 #include <l4/l4re_vfs/backend>
 #include <l4/cxx/string>
 #include <l4/cxx/avl_tree>
+#include <l4/cxx/minmax>
+#include <l4/re/env>
+#include <l4/re/mem_alloc>
+#include <l4/re/rm>
 
 #include <sys/stat.h>
 #include <sys/ioctl.h>
@@ -26,10 +30,25 @@ namespace {
 using namespace L4Re::Vfs;
 using cxx::Ref_ptr;
 
+/**
+ * Contents of a file, stored in a dataspace.
+ *
+ * The dataspace is allocated with the maximum file size on the first write
+ * and handed out for mmap(). Its memory is allocated lazily, so pages that
+ * were never written to do not take up memory and read as zero. Only the
+ * first part of it (the capacity) is attached into the local address space
+ * for reading and writing. Growing the file attaches a larger part of the
+ * same dataspace, so the contents never move or get copied.
+ *
+ * Memory comes from the allocator given to the file system at mount time,
+ * e.g. a same-page merging allocator, so that identical files of several
+ * clients end up sharing memory.
+ */
 class File_data
 {
 public:
-  File_data() : _buf(0), _size(0) {}
+  explicit File_data(L4::Cap<L4Re::Mem_alloc> alloc)
+  : _alloc(alloc), _addr(0), _capacity(0), _size(0) {}
 
   unsigned long put(unsigned long offset,
                     unsigned long bufsize, void *srcbuf);
@@ -39,23 +58,116 @@ public:
   unsigned long size(unsigned long offset);
   unsigned long size() const { return _size; }
 
-  ~File_data() throw() { free(_buf); }
+  /**
+   * Dataspace holding the file contents, invalid until the first write.
+   *
+   * The dataspace is larger than the file, the part behind the end of the
+   * file reads as zero.
+   */
+  L4::Cap<L4Re::Dataspace> ds() const { return _ds; }
+
+  ~File_data() throw() { release(_ds, _addr); }
 
 private:
-  void *_buf;
+  enum
+  {
+    Min_capacity = 4 * L4_PAGESIZE,
+    Max_size     = 256UL << 20,
+  };
+
+  bool grow(unsigned long size);
+  static void release(L4::Cap<L4Re::Dataspace> ds, l4_addr_t addr);
+
+  L4::Cap<L4Re::Mem_alloc> _alloc;
+  L4::Cap<L4Re::Dataspace> _ds;
+  l4_addr_t _addr;
+  unsigned long _capacity;
   unsigned long _size;
 };
 
+void
+File_data::release(L4::Cap<L4Re::Dataspace> ds, l4_addr_t addr)
+{
+  if (addr)
+    L4Re::Env::env()->rm()->detach(addr, 0);
+
+  if (ds.is_valid())
+    L4Re::virt_cap_alloc->release(ds, L4Re::This_task);
+}
+
+/**
+ * Attach at least the given size of the dataspace.
+ *
+ * \return true on success, false if the size exceeds the maximum file size
+ *         or there is not enough memory. The contents stay attached as they
+ *         are on failure.
+ */
+bool
+File_data::grow(unsigned long size)
+{
+  if (size > Max_size)
+    return false;
+
+  if (!_ds.is_valid())
+    {
+      L4::Cap<L4Re::Dataspace> ds
+        = L4Re::virt_cap_alloc->alloc<L4Re::Dataspace>();
+      if (!ds.is_valid())
+        return false;
+
+      if (_alloc->alloc(Max_size, ds) < 0)
+        {
+          release(ds, 0);
+          return false;
+        }
+
+      _ds = ds;
+    }
+
+  unsigned long capacity = cxx::max<unsigned long>(_capacity, Min_capacity);
+  while (capacity < size)
+    capacity *= 2;
+  capacity = cxx::min<unsigned long>(capacity, Max_size);
+
+  l4_addr_t addr = 0;
+  if (L4Re::Env::env()->rm()->attach(&addr, capacity,
+                                     L4Re::Rm::F::Search_addr
+                                     | L4Re::Rm::F::RW,
+                                     L4::Ipc::make_cap_rw(_ds)) < 0)
+    return false;
+
+  if (_addr)
+    L4Re::Env::env()->rm()->detach(_addr, 0);
+
+  _addr = addr;
+  _capacity = capacity;
+  return true;
+}
+
 unsigned long
 File_data::put(unsigned long offset, unsigned long bufsize, void *srcbuf)
 {
-  if (offset + bufsize > _size)
-    size(offset + bufsize);
+  // files do not grow beyond the maximum size
+  if (offset + bufsize > Max_size)
+    {
+      if (offset >= Max_size)
+        return 0;
+      bufsize = Max_size - offset;
+    }
 
-  if (!_buf)
-    return 0;
+  if (offset + bufsize > _capacity && !grow(offset + bufsize))
+    {
+      // write as much as still fits
+      if (offset >= _capacity)
+        return 0;
+      bufsize = _capacity - offset;
+    }
+
+  memcpy((char *)_addr + offset, srcbuf, bufsize);
+
+  if (offset + bufsize > _size)
+    _size = offset + bufsize;
 
-  memcpy((char *)_buf + offset, srcbuf, bufsize);
   return bufsize;
 }
 
@@ -70,22 +182,31 @@ File_data::get(unsigned long offset, unsigned long bufsize, void *dstbuf)
   if (offset + bufsize > _size)
     s = _size - offset;
 
-  memcpy(dstbuf, (char *)_buf + offset, s);
+  memcpy(dstbuf, (char *)_addr + offset, s);
   return s;
 }
 
 unsigned long
 File_data::size(unsigned long offset)
 {
-  if (offset != _size)
+  if (offset > _capacity && !grow(offset))
+    return -1;
+
+  if (offset < _size)
     {
-      _size = offset;
-      _buf = realloc(_buf, _size);
+      // release the pages behind the new end
+      unsigned long first = l4_round_page(offset);
+      if (first < _capacity)
+        _ds->clear(first, _capacity - first);
+
+      // the rest of the last page reads as zero if the file grows again
+      if (first > offset)
+        memset((char *)_addr + offset, 0,
+               cxx::min(first, _size) - offset);
     }
 
-  if (_buf)
-    return 0;
-  return -ENOSPC;
+  _size = offset;
+  return 0;
 }
 
 
@@ -136,8 +257,8 @@ struct Path_avl_tree_compare
 class Pers_file : public Node
 {
 public:
-  Pers_file(const char *name, mode_t mode)
-    : Node(name, (mode & 0777) | __S_IFREG) {}
+  Pers_file(const char *name, mode_t mode, L4::Cap<L4Re::Mem_alloc> alloc)
+    : Node(name, (mode & 0777) | __S_IFREG), _data(alloc) {}
   File_data const &data() const { return _data; }
   File_data &data() { return _data; }
 private:
@@ -177,8 +298,9 @@ bool Pers_dir::add_node(Ref_ptr<Node> const &n)
 class Tmpfs_dir : public Be_file
 {
 public:
-  explicit Tmpfs_dir(Ref_ptr<Pers_dir> const &d) throw()
-    : _dir(d), _getdents_state(false) {}
+  Tmpfs_dir(Ref_ptr<Pers_dir> const &d,
+            L4::Cap<L4Re::Mem_alloc> alloc) throw()
+    : _dir(d), _alloc(alloc), _getdents_state(false) {}
   int get_entry(const char *, int, mode_t, Ref_ptr<File> *) throw();
   ssize_t getdents(char *, size_t) throw();
   int fstat64(struct stat64 *buf) const throw();
@@ -194,6 +316,7 @@ private:
                 Ref_ptr<Node> *ret, cxx::String *remaining = 0);
 
   Ref_ptr<Pers_dir> _dir;
+  L4::Cap<L4Re::Mem_alloc> _alloc;
   bool _getdents_state;
   Pers_dir::Const_iterator _getdents_iter;
 };
@@ -210,6 +333,7 @@ public:
   int ioctl(unsigned long, va_list) throw();
   int utime(const struct utimbuf *) throw();
   int fchmod(mode_t) throw();
+  L4::Cap<L4Re::Dataspace> data_space() const throw();
 
 private:
   ssize_t preadv(const struct iovec *v, int iovcnt, off64_t p) throw();
@@ -266,6 +390,9 @@ int Tmpfs_file::ftruncate64(off64_t p) throw()
 off64_t Tmpfs_file::size() const throw()
 { return _file->data().size(); }
 
+L4::Cap<L4Re::Dataspace> Tmpfs_file::data_space() const throw()
+{ return _file->data().ds(); }
+
 int
 Tmpfs_file::ioctl(unsigned long v, va_list args) throw()
 {
@@ -344,7 +471,7 @@ Tmpfs_dir::get_entry(const char *name, int flags, mode_t mode,
 
   if ((flags & O_CREAT) && e == -ENOENT)
     {
-      Ref_ptr<Node> node(new Pers_file(n.start(), mode));
+      Ref_ptr<Node> node(new Pers_file(n.start(), mode, _alloc));
       // when ENOENT is return, path is always a directory
       bool e = cxx::ref_ptr_static_cast<Pers_dir>(path)->add_node(node);
       if (!e)
@@ -353,7 +480,8 @@ Tmpfs_dir::get_entry(const char *name, int flags, mode_t mode,
     }
 
   if (path->is_dir())
-    *file = cxx::ref_ptr(new Tmpfs_dir(cxx::ref_ptr_static_cast<Pers_dir>(path)));
+    *file = cxx::ref_ptr(new Tmpfs_dir(cxx::ref_ptr_static_cast<Pers_dir>(path),
+                                       _alloc));
   else
     *file = cxx::ref_ptr(new Tmpfs_file(cxx::ref_ptr_static_cast<Pers_file>(path)));
 
@@ -553,12 +681,33 @@ public:
   {
     (void)mountflags;
     (void)source;
-    (void)data;
-    *dir = cxx::ref_ptr(new Tmpfs_dir(cxx::ref_ptr(new Pers_dir("root", 0777))));
+    L4::Cap<L4Re::Mem_alloc> alloc = allocator(static_cast<char const *>(data));
+    if (!alloc.is_valid())
+      return -ENOENT;
+
+    *dir = cxx::ref_ptr(new Tmpfs_dir(cxx::ref_ptr(new Pers_dir("root", 0777)),
+                                      alloc));
     if (!*dir)
       return -ENOMEM;
     return 0;
   }
+
+private:
+  /**
+   * Allocator for file contents, given as "allocator=<cap name>" in the
+   * mount data. Defaults to the memory allocator of the environment.
+   */
+  static L4::Cap<L4Re::Mem_alloc> allocator(char const *data)
+  {
+    static char const opt[] = "allocator=";
+    char const *name = data ? strstr(data, opt) : 0;
+    if (!name)
+      return L4Re::Env::env()->mem_alloc();
+
+    name += sizeof(opt) - 1;
+    return L4Re::Env::env()->get_cap<L4Re::Mem_alloc>(name,
+                                                      strcspn(name, ","));
+  }
 };
 
 static Tmpfs_fs _tmpfs L4RE_VFS_FILE_SYSTEM_ATTRIBUTE;
@@ -36,11 +36,17 @@ public:
       create_state(determine_vmm_type());
   }
 
-  bool pf_write() const
+  /**
+   * Kind of access that caused the current guest memory fault.
+   */
+  Fault_type fault_type() const
   {
-    return vm_state()->pf_write();
+    return vm_state()->fault_type();
   }
 
+  bool pf_write() const
+  { return fault_type() == Fault_type::Write; }
+
   void thread_attach()
   {
     control_ext(L4::Cap<L4::Thread>());
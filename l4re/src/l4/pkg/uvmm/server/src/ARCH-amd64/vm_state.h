@@ -9,6 +9,8 @@
 
 #include <l4/sys/types.h>
 
+#include "mem_access.h"
+
 namespace Vmm {
 
 class Vm_state
@@ -21,7 +23,7 @@ public:
   virtual void setup_real_mode(l4_addr_t entry) = 0;
 
   virtual l4_umword_t ip() const = 0;
-  virtual bool pf_write() const = 0;
+  virtual Fault_type fault_type() const = 0;
   virtual l4_umword_t cr3() const = 0;
   virtual bool interrupts_enabled() const = 0;
 
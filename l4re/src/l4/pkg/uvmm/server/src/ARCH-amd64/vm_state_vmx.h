@@ -203,8 +203,16 @@ public:
     vmx_write(VMCS_GUEST_IA32_EFER, 0x0);
   }
 
-  bool pf_write() const override
-  { return vmx_read(VMCS_EXIT_QUALIFICATION) & 0x2; }
+  Fault_type fault_type() const override
+  {
+    // EPT violation exit qualification: bit 1 write, bit 2 instruction fetch
+    l4_uint64_t qual = vmx_read(VMCS_EXIT_QUALIFICATION);
+    if (qual & 0x2)
+      return Fault_type::Write;
+    if (qual & 0x4)
+      return Fault_type::Exec;
+    return Fault_type::Read;
+  }
 
   l4_umword_t ip() const override
   { return l4_vm_vmx_read_nat(_vmcs, VMCS_GUEST_RIP); }
@@ -20,8 +20,14 @@ class Vcpu_ptr : public Generic_vcpu_ptr
 public:
   explicit Vcpu_ptr(l4_vcpu_state_t *s) : Generic_vcpu_ptr(s) {}
 
+  /**
+   * Kind of access that caused the current guest memory fault.
+   */
+  Fault_type fault_type() const
+  { return hsr().pf_type(); }
+
   bool pf_write() const
-  { return hsr().pf_write(); }
+  { return fault_type() == Fault_type::Write; }
 
   static l4_uint32_t cntfrq()
   {
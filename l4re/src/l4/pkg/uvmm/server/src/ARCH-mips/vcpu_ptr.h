@@ -82,8 +82,26 @@ class Vcpu_ptr : public Generic_vcpu_ptr
 public:
   explicit Vcpu_ptr(l4_vcpu_state_t *s) : Generic_vcpu_ptr(s) {}
 
+  /**
+   * Kind of access that caused the current guest memory fault.
+   *
+   * TLB load exceptions do not tell data loads and instruction fetches
+   * apart, both are reported as reads.
+   */
+  Fault_type fault_type() const
+  {
+    switch ((_s->r.cause >> 2) & 0x1f)
+      {
+      case 1: // TLB modify
+      case 3: // TLB store
+        return Fault_type::Write;
+      default:
+        return Fault_type::Read;
+      }
+  }
+
   bool pf_write() const
-  { return _s->r.cause & 4; }
+  { return fault_type() == Fault_type::Write; }
 
   void thread_attach()
   {
@@ -12,6 +12,8 @@
 #include <l4/sys/irq>
 #include <l4/cxx/bitfield>
 
+#include "mem_access.h"
+
 namespace Vmm {
 namespace Arm {
 
@@ -103,6 +105,21 @@ public:
   CXX_BITFIELD_MEMBER( 7,  7, pf_s1ptw, _raw);
   CXX_BITFIELD_MEMBER( 6,  6, pf_write, _raw);
   CXX_BITFIELD_MEMBER( 0,  5, pf_fsc, _raw);
+
+  /**
+   * Kind of access that caused a guest memory fault with this syndrome.
+   *
+   * Cache maintenance operations report a write access (WnR=1) even though
+   * they do not modify memory, so they are reported as reads.
+   */
+  Fault_type pf_type() const
+  {
+    if (ec() == Ec_iabt_low)
+      return Fault_type::Exec;
+    if (pf_write() && !pf_cache_maint())
+      return Fault_type::Write;
+    return Fault_type::Read;
+  }
 };
 
 enum Ttbcr
@@ -0,0 +1,361 @@
+/*
+ * This file is distributed under the terms of the GNU General Public
+ * License, version 2.  Please see the COPYING-GPL-2 file for details.
+ */
+
+#include "debug.h"
+#include "device_factory.h"
+#include "guest.h"
+#include "irq.h"
+#include "mmio_device.h"
+#include "virtio_dev.h"
+#include "virtio_event_connector.h"
+#include "monitor/virtio_balloon_cmd_handler.h"
+
+#include <l4/l4virtio/virtio.h>
+
+namespace Vdev {
+
+/**
+ * Virtio memory balloon.
+ *
+ * The guest hands pages to the balloon (inflate queue) and takes them back
+ * (deflate queue) according to the balloon size requested by the host. In
+ * addition, the guest may report ranges of free memory (free page reporting).
+ * Inflated pages and reported ranges are returned to the provider of the
+ * guest RAM via L4Re::Dataspace::clear(). When the guest RAM is provided by
+ * spmm, the pages are dropped from its scan queue as well.
+ *
+ * The balloon size is controlled through the monitor interface ('balloon').
+ *
+ * Example device tree entry:
+ *   virtio_balloon@30000 {
+ *     compatible = "virtio,mmio";
+ *     reg = <0x30000 0x100>;
+ *     interrupt-parent = <0x1>;
+ *     interrupts = <0x0 0x7b 0x4>;
+ *     l4vmm,vdev = "balloon";
+ *   };
+ */
+class Virtio_balloon_mmio
+: public Virtio::Dev,
+  public Vmm::Ro_ds_mapper_t<Virtio_balloon_mmio>,
+  public Virtio::Mmio_connector<Virtio_balloon_mmio>,
+  public Monitor::Virtio_balloon_cmd_handler<Monitor::Enabled,
+                                             Virtio_balloon_mmio>
+{
+  typedef L4virtio::Svr::Virtqueue::Desc Desc;
+  typedef L4virtio::Svr::Request_processor Request_processor;
+
+  struct Payload
+  {
+    l4_uint64_t addr;
+    char *data;
+    unsigned len;
+  };
+
+  struct Balloon_config
+  {
+    l4_uint32_t num_pages;
+    l4_uint32_t actual;
+  };
+
+  enum
+  {
+    Inflate_queue = 0,
+    Deflate_queue = 1,
+    Reporting_queue = 2,
+    Balloon_queue_num = 3,
+    Balloon_queue_length = 0x100,
+
+    // The balloon always uses 4K page frame numbers.
+    Balloon_pfn_shift = 12,
+  };
+
+public:
+  struct Features : Virtio::Dev::Features
+  {
+    CXX_BITFIELD_MEMBER(0, 0, must_tell_host, raw);
+    CXX_BITFIELD_MEMBER(1, 1, stats_vq, raw);
+    CXX_BITFIELD_MEMBER(2, 2, deflate_on_oom, raw);
+    CXX_BITFIELD_MEMBER(3, 3, free_page_hint, raw);
+    CXX_BITFIELD_MEMBER(4, 4, page_poison, raw);
+    CXX_BITFIELD_MEMBER(5, 5, page_reporting, raw);
+
+    explicit Features(l4_uint32_t v)
+    : Virtio::Dev::Features(v)
+    {}
+  };
+
+  Virtio_balloon_mmio(Vmm::Vm_ram *ram)
+  : Virtio::Dev(ram, 0x44, L4VIRTIO_ID_BALLOON),
+    _ram(ram)
+  {
+    // The stats and free page hint queues are not offered, hence the
+    // reporting queue immediately follows the deflate queue.
+    Features feat(0);
+    feat.ring_indirect_desc() = true;
+    feat.deflate_on_oom() = true;
+    feat.page_reporting() = true;
+    _cfg_header->dev_features_map[0] = feat.raw;
+    _cfg_header->num_queues = Balloon_queue_num;
+
+    for (auto &q : _vqs)
+      q.config.num_max = Balloon_queue_length;
+
+    update_virtio_config();
+  }
+
+  int init_irqs(Vdev::Device_lookup *devs, Vdev::Dt_node const &self)
+  { return event_connector()->init_irqs(devs, self); }
+
+  Virtio::Event_connector_irq *event_connector() { return &_evcon; }
+
+  void virtio_queue_ready(unsigned ready)
+  {
+    auto *q = current_virtqueue();
+    if (!q)
+      return;
+
+    auto *qc = &q->config;
+
+    if (ready == 0 && q->ready())
+      {
+        q->disable();
+        qc->ready = 0;
+      }
+    else if (ready == 1 && !q->ready())
+      {
+        qc->ready = 0;
+        l4_uint16_t num = qc->num;
+        // num must be: a power of two in range [1,num_max].
+        if (!num || (num & (num - 1)) || num > qc->num_max)
+          return;
+
+        q->init_queue(devaddr_to_virt<void>(qc->desc_addr),
+                      devaddr_to_virt<void>(qc->avail_addr),
+                      devaddr_to_virt<void>(qc->used_addr));
+        qc->ready = 1;
+      }
+  }
+
+  void reset() override
+  {
+    for (auto &q : _vqs)
+      {
+        q.disable();
+        q.config.ready = 0;
+      }
+  }
+
+  void virtio_queue_notify(unsigned val)
+  {
+    Virtio::Event_set ev;
+
+    switch (val)
+      {
+      case Inflate_queue:   handle_inflate(&ev); break;
+      case Deflate_queue:   handle_deflate(&ev); break;
+      case Reporting_queue: handle_reporting(&ev); break;
+      default:
+        Dbg(Dbg::Dev, Dbg::Warn, "balloon")
+          .printf("Notification for unknown queue %u\n", val);
+        return;
+      }
+
+    if (_cfg_header->irq_status != _irq_status_shadow)
+      set_irq_status(_irq_status_shadow);
+
+    event_connector()->send_events(cxx::move(ev));
+  }
+
+  void virtio_irq_ack(unsigned val)
+  {
+    _irq_status_shadow &= ~val;
+    if (_cfg_header->irq_status != _irq_status_shadow)
+      set_irq_status(_irq_status_shadow);
+
+    event_connector()->clear_events(val);
+  }
+
+  void load_desc(Desc const &desc, Request_processor const *, Payload *p)
+  {
+    p->addr = desc.addr.get();
+    p->data = devaddr_to_virt<char>(desc.addr.get(), desc.len);
+    p->len = desc.len;
+  }
+
+  void load_desc(Desc const &desc, Request_processor const *,
+                 Desc const **table)
+  {
+    *table = devaddr_to_virt<Desc const>(desc.addr.get(), sizeof(Desc));
+  }
+
+  Virtio::Virtqueue *virtqueue(unsigned qn) override
+  { return qn < Balloon_queue_num ? &_vqs[qn] : nullptr; }
+
+  /**
+   * Request a new balloon size from the guest.
+   *
+   * \param pages  Requested number of pages in the balloon.
+   */
+  void set_target(l4_uint32_t pages)
+  {
+    auto *cfg = virtio_device_config<Balloon_config>();
+    cfg->num_pages = pages;
+    writeback_cache(cfg);
+
+    // Signal the configuration change.
+    _irq_status_shadow |= 2;
+    if (_cfg_header->irq_status != _irq_status_shadow)
+      set_irq_status(_irq_status_shadow);
+
+    event_connector()->send_event(_config_event_index);
+  }
+
+  l4_uint32_t target()
+  { return virtio_device_config<Balloon_config>()->num_pages; }
+
+  l4_uint32_t actual()
+  { return virtio_device_config<Balloon_config>()->actual; }
+
+  l4_uint64_t inflated_pages() const { return _inflated_pages; }
+  l4_uint64_t reported_bytes() const { return _reported_bytes; }
+
+private:
+  void release(l4_uint64_t addr, l4_uint64_t size)
+  {
+    long err = _ram->release(Vmm::Guest_addr(addr), size);
+    if (err < 0)
+      Dbg(Dbg::Dev, Dbg::Warn, "balloon")
+        .printf("Cannot release 0x%llx-0x%llx: %ld\n",
+                addr, addr + size - 1, err);
+  }
+
+  void finish(Virtio::Virtqueue *q, L4virtio::Svr::Virtqueue::Request const &r,
+              Virtio::Event_set *ev)
+  {
+    q->consumed(r);
+    if (!q->no_notify_guest())
+      {
+        _irq_status_shadow |= 1;
+        ev->set(q->config.driver_notify_index);
+      }
+  }
+
+  /**
+   * Release every page whose page frame number the guest put into the
+   * inflate queue.
+   */
+  void handle_inflate(Virtio::Event_set *ev)
+  {
+    auto *q = &_vqs[Inflate_queue];
+
+    while (q->ready())
+      {
+        auto r = q->next_avail();
+        if (!r)
+          break;
+
+        Request_processor rp;
+        Payload p;
+        rp.start(this, r, &p);
+
+        for (;;)
+          {
+            l4_uint32_t const *pfns = reinterpret_cast<l4_uint32_t *>(p.data);
+            for (unsigned i = 0; i < p.len / sizeof(l4_uint32_t); ++i)
+              {
+                l4_uint64_t addr = l4_uint64_t(pfns[i]) << Balloon_pfn_shift;
+                release(addr, 1UL << Balloon_pfn_shift);
+                ++_inflated_pages;
+              }
+
+            if (!rp.next(this, &p))
+              break;
+          }
+
+        finish(q, r, ev);
+      }
+  }
+
+  /**
+   * The guest takes back pages from the balloon. Released pages are
+   * repopulated on the next guest access, so there is nothing to do.
+   */
+  void handle_deflate(Virtio::Event_set *ev)
+  {
+    auto *q = &_vqs[Deflate_queue];
+
+    while (q->ready())
+      {
+        auto r = q->next_avail();
+        if (!r)
+          break;
+
+        finish(q, r, ev);
+      }
+  }
+
+  /**
+   * Release every range of free guest memory that the guest reported.
+   */
+  void handle_reporting(Virtio::Event_set *ev)
+  {
+    auto *q = &_vqs[Reporting_queue];
+
+    while (q->ready())
+      {
+        auto r = q->next_avail();
+        if (!r)
+          break;
+
+        Request_processor rp;
+        Payload p;
+        rp.start(this, r, &p);
+
+        for (;;)
+          {
+            release(p.addr, p.len);
+            _reported_bytes += p.len;
+
+            if (!rp.next(this, &p))
+              break;
+          }
+
+        finish(q, r, ev);
+      }
+  }
+
+  Vmm::Vm_ram *_ram;
+  Virtio::Virtqueue _vqs[Balloon_queue_num];
+  Virtio::Event_connector_irq _evcon;
+  l4_uint64_t _inflated_pages = 0;
+  l4_uint64_t _reported_bytes = 0;
+};
+
+}
+
+namespace {
+
+using namespace Vdev;
+
+struct F : Factory
+{
+  cxx::Ref_ptr<Device> create(Device_lookup *devs, Dt_node const &node) override
+  {
+    Dbg(Dbg::Dev, Dbg::Info).printf("Create virtual memory balloon\n");
+
+    auto c = make_device<Virtio_balloon_mmio>(devs->ram().get());
+    if (c->init_irqs(devs, node) < 0)
+      return nullptr;
+
+    devs->vmm()->register_mmio_device(c, Vmm::Region_type::Virtual, node);
+    return c;
+  }
+};
+
+static F f;
+static Device_type t = { "virtio,mmio", "balloon", &f };
+
+}
@@ -15,6 +15,7 @@
 #include "mmio_device.h"
 #include "vcpu_ptr.h"
 #include "ds_manager.h"
+#include "fault_stats.h"
 
 #ifndef MAP_OTHER
 /**
@@ -48,6 +49,10 @@ public:
         .printf("Region not page aligned\n");
   }
 
+  /// account the faults handled by access() in `stats`
+  void fault_stats(Vmm::Fault_stats *stats)
+  { _fault_stats = stats; }
+
 private:
   /// manager for a portion of a dataspace + local mapping
   cxx::Ref_ptr<Vmm::Ds_manager> _ds;
@@ -61,6 +66,9 @@ private:
   /// Special properties of the dataspace
   Flags _flags;
 
+  /// Fault statistics, if any
+  Vmm::Fault_stats *_fault_stats = nullptr;
+
   /**
    * Get the full offset from the start of the dataspace.
    *
@@ -118,20 +126,24 @@ private:
   int access(l4_addr_t pfa, l4_addr_t offset, Vmm::Vcpu_ptr vcpu,
              L4::Cap<L4::Vm> vm_task, l4_addr_t min, l4_addr_t max) override
   {
+    l4_uint64_t start = _fault_stats ? Vmm::Fault_stats::now() : 0;
+    bool write = vcpu.fault_type() == Vmm::Fault_type::Write;
+    unsigned char ps = L4_PAGESHIFT;
     long res;
     l4_addr_t ls = local_start();
-    // Make sure that the page is currently mapped.
-    // TODO: This is an Arm-specific hack. Make ISA-independent!
-    res = page_in(ls + offset, vcpu.pf_write());
+    // Make sure that the page is currently mapped. Read faults page in
+    // read-only, so that the mapping to the guest below is read-only as
+    // well and does not break up pages merged by the dataspace provider.
+    res = page_in(ls + offset, write);
 
     if (res >= 0)
       {
         // We assume that the region manager provided the largest possible
         // page size and try to map the largest possible page to the
         // client.
-        unsigned char ps = get_page_shift(pfa, min, max, offset, ls);
+        ps = get_page_shift(pfa, min, max, offset, ls);
 
-        if (vcpu.pf_write() && !(_rights & L4_FPAGE_W))
+        if (write && !(_rights & L4_FPAGE_W))
           {
             Err().printf(
               "not handling VM write access @ %lx ip=%lx on read-only area\n",
@@ -153,6 +165,9 @@ private:
         return res;
       }
 
+    if (_fault_stats)
+      _fault_stats->add(write, ps, start);
+
     return Vmm::Retry;
   }
 
@@ -193,6 +208,10 @@ public:
     (void)flags;
   }
 
+  /// account the faults handled by access() in `stats`
+  void fault_stats(Vmm::Fault_stats *stats)
+  { _fault_stats = stats; }
+
 private:
   /// just keep the dataspace cap (no local region is needed)
   L4Re::Util::Ref_cap<L4Re::Dataspace>::Cap _ds;
@@ -203,6 +222,9 @@ private:
   /// store the offset relative to the start of the dataspace.
   l4_addr_t _offset;
 
+  /// Fault statistics, if any
+  Vmm::Fault_stats *_fault_stats = nullptr;
+
   bool _mergable(cxx::Ref_ptr<Mmio_device> other,
                  Vmm::Guest_addr start_other, Vmm::Guest_addr start_this) override
   {
@@ -228,7 +250,10 @@ private:
   int access(l4_addr_t pfa, l4_addr_t offset, Vmm::Vcpu_ptr vcpu,
              L4::Cap<L4::Vm> vm_task, l4_addr_t min, l4_addr_t max) override
   {
-    if (vcpu.pf_write() && !(_rights & L4_FPAGE_W))
+    l4_uint64_t start = _fault_stats ? Vmm::Fault_stats::now() : 0;
+    bool write = vcpu.fault_type() == Vmm::Fault_type::Write;
+
+    if (write && !(_rights & L4_FPAGE_W))
       {
         Err().printf(
           "not handling VM write access @ %lx ip=%lx on read-only area\n",
@@ -236,7 +261,10 @@ private:
         return -L4_EPERM;
       }
 
-    long res = _ds->map(offset + _offset, L4Re::Dataspace::Flags(_rights),
+    // Map read faults read-only, so that pages merged by the dataspace
+    // provider stay merged until the guest writes to them.
+    unsigned char rights = write ? _rights : (_rights & ~L4_FPAGE_W);
+    long res = _ds->map(offset + _offset, L4Re::Dataspace::Flags(rights),
                         pfa, min, max, vm_task);
 
     if (res < 0)
@@ -246,6 +274,10 @@ private:
         return res;
       }
 
+    // the dataspace picks the page size, which is not reported back
+    if (_fault_stats)
+      _fault_stats->add(write, L4_PAGESHIFT, start);
+
     return Vmm::Retry;
   }
 
@@ -0,0 +1,121 @@
+/*
+ * This file is distributed under the terms of the GNU General Public
+ * License, version 2.  Please see the COPYING-GPL-2 file for details.
+ */
+#pragma once
+
+#include <atomic>
+
+#include <l4/re/env.h>
+#include <l4/sys/consts.h>
+#include <l4/sys/kip.h>
+#include <l4/sys/l4int.h>
+
+namespace Vmm {
+
+/**
+ * Statistics on guest accesses to RAM that is not mapped into the VM yet
+ * (stage-2 faults).
+ *
+ * Faults are classified by the kind of access and by the size of the mapping
+ * that was requested to resolve them. The kernel does not report the size it
+ * actually mapped, which is smaller if the source is mapped in smaller pages
+ * locally (e.g. because the dataspace provider merged some of them). A fault
+ * in the Superpage_requested class thus did not necessarily establish a
+ * superpage. Each class keeps the number of faults, their total and maximum
+ * latency and a latency histogram.
+ *
+ * The counters are updated by all vCPU threads without further locking, so
+ * a reader might see the counters of a class in a slightly inconsistent
+ * state.
+ */
+class Fault_stats
+{
+public:
+  enum
+  {
+    /**
+     * Number of histogram buckets. Bucket 0 counts latencies below 1us,
+     * bucket i latencies below 2^i us, the last bucket all others.
+     */
+    Num_buckets = 12,
+  };
+
+  enum Access { Read, Write, Num_access };
+  enum Mapping { Page, Superpage_requested, Num_mappings };
+
+  struct Counters
+  {
+    std::atomic<l4_uint64_t> faults = { 0 };
+    std::atomic<l4_uint64_t> total_ns = { 0 };
+    std::atomic<l4_uint64_t> max_ns = { 0 };
+    std::atomic<l4_uint64_t> buckets[Num_buckets] = {};
+  };
+
+  /**
+   * Current time, as a base for latencies passed to add().
+   */
+  static l4_uint64_t now()
+  { return l4_kip_clock_ns(l4re_kip()); }
+
+  /**
+   * Account a resolved fault.
+   *
+   * \param write       True for a write access.
+   * \param page_shift  Size of the mapping requested to resolve the fault.
+   * \param start       Time the fault handling started, see now().
+   */
+  void add(bool write, unsigned page_shift, l4_uint64_t start)
+  {
+    l4_uint64_t ns = now() - start;
+    Mapping m = page_shift > L4_PAGESHIFT ? Superpage_requested : Page;
+    Counters &c = _counters[write ? Write : Read][m];
+
+    c.faults.fetch_add(1, std::memory_order_relaxed);
+    c.total_ns.fetch_add(ns, std::memory_order_relaxed);
+    c.buckets[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+
+    l4_uint64_t max = c.max_ns.load(std::memory_order_relaxed);
+    while (ns > max
+           && !c.max_ns.compare_exchange_weak(max, ns,
+                                              std::memory_order_relaxed))
+      ;
+  }
+
+  Counters const &counters(Access access, Mapping mapping) const
+  { return _counters[access][mapping]; }
+
+  /**
+   * Reset all counters.
+   */
+  void reset()
+  {
+    for (auto &a : _counters)
+      for (Counters &c : a)
+        {
+          c.faults = 0;
+          c.total_ns = 0;
+          c.max_ns = 0;
+          for (auto &b : c.buckets)
+            b = 0;
+        }
+  }
+
+  /**
+   * Histogram bucket for a latency.
+   */
+  static unsigned bucket(l4_uint64_t ns)
+  {
+    l4_uint64_t us = ns / 1000;
+    if (!us)
+      return 0;
+
+    unsigned b = 64 - __builtin_clzll(us);
+    return b < Num_buckets ? b : Num_buckets - 1;
+  }
+
+private:
+  Counters _counters[Num_access][Num_mappings];
+};
+
+}
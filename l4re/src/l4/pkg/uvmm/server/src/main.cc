@@ -141,7 +141,7 @@ setup_kaslr_seed(Vdev::Host_dt const &dt)
   node.setprop_u64("kaslr-seed", random.r);
 }
 
-static char const *const options = "+k:d:r:c:b:vqD:f:i";
+static char const *const options = "+k:d:r:c:b:vqD:f:iM";
 static struct option const loptions[] =
 {
     { "kernel",                  required_argument, NULL, 'k' },
@@ -154,6 +154,7 @@ static struct option const loptions[] =
     { "quiet",                   no_argument,       NULL, 'q' },
     { "wakeup-on-system-resume", no_argument,       NULL, 'W' },
     { "fault-mode",              required_argument, NULL, 'f' },
+    { "merge-files",             no_argument,       NULL, 'M' },
     { 0, 0, 0, 0}
 };
 
@@ -198,6 +199,7 @@ int main(int argc, char *argv[])
   bool use_wakeup_inhibitor = false;
   Vmm::Guest::Fault_mode fault_mode = Vmm::Guest::Fault_mode::Ignore;
   bool force_ram_identity_mapping = false;
+  bool merge_files = false;
 
   int opt;
   while ((opt = getopt_long(argc, argv, options, loptions, NULL)) != -1)
@@ -234,6 +236,9 @@ int main(int argc, char *argv[])
         case 'W':
           use_wakeup_inhibitor = true;
           break;
+        case 'M':
+          merge_files = true;
+          break;
         case 'f':
           if (!str_to_fault_mode(optarg, &fault_mode))
             {
@@ -256,6 +261,7 @@ int main(int argc, char *argv[])
   auto *ram = vm_instance.ram().get();
 
   vmm->set_fault_mode(fault_mode);
+  ram->merge_files(merge_files);
 
   if (use_wakeup_inhibitor)
     vm_instance.pm()->use_wakeup_inhibitor(true);
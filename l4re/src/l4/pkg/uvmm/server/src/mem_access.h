@@ -12,6 +12,16 @@
 
 namespace Vmm {
 
+/**
+ * Kind of guest access that caused a fault on guest memory.
+ */
+enum class Fault_type
+{
+  Read,  /// data load, including cache maintenance operations
+  Write, /// data store
+  Exec,  /// instruction fetch
+};
+
 /**
  * Describes a load/store instruction.
  */
@@ -0,0 +1,54 @@
+/*
+ * This file is distributed under the terms of the GNU General Public
+ * License, version 2.  Please see the COPYING-GPL-2 file for details.
+ */
+#pragma once
+
+#include <cstdio>
+
+#include <l4/sys/l4int.h>
+
+#include "monitor/monitor.h"
+#include "monitor/monitor_args.h"
+
+namespace Monitor {
+
+template<bool, typename T>
+class Virtio_balloon_cmd_handler {};
+
+template<typename T>
+class Virtio_balloon_cmd_handler<true, T> : public Cmd
+{
+public:
+  Virtio_balloon_cmd_handler()
+  { register_toplevel("balloon"); }
+
+  char const *help() const override
+  { return "Memory balloon"; }
+
+  void usage(FILE *f) const override
+  {
+    fprintf(f, "%s\n"
+               "* 'balloon': show balloon size and released memory\n"
+               "* 'balloon <n>': request a balloon size of <n> pages\n",
+            help());
+  }
+
+  void exec(FILE *f, Arglist *args) override
+  {
+    if (!args->empty())
+      virtio_balloon()->set_target(args->pop<l4_uint32_t>("Invalid size"));
+
+    fprintf(f, "target: %u pages, actual: %u pages\n",
+            virtio_balloon()->target(), virtio_balloon()->actual());
+    fprintf(f, "released: %llu inflated pages, %llu reported bytes\n",
+            virtio_balloon()->inflated_pages(),
+            virtio_balloon()->reported_bytes());
+  }
+
+private:
+  T *virtio_balloon()
+  { return static_cast<T *>(this); }
+};
+
+}
@@ -37,13 +37,14 @@ public:
     fprintf(f, "%s\n"
                "* 'ram ds': list RAM dataspaces\n"
                "* 'ram dump <addr> [<n> [(b|w|d|q)]]': dump RAM region\n"
+               "* 'ram faults [reset]': show (or reset) RAM fault statistics\n"
                "where: * b = byte, w = word (16 bits), d = double word, q = quad word\n"
                "       * <n> = number of entries to be dumped\n",
             help());
   }
 
   void complete(FILE *f, Completion_request *compl_req) const override
-  { compl_req->complete(f, {"ds", "dump"}); }
+  { compl_req->complete(f, {"ds", "dump", "faults"}); }
 
   void exec(FILE *f, Arglist *args) override
   {
@@ -53,6 +54,15 @@ public:
       show_dataspaces(f);
     else if (subcmd == "dump")
       dump_memory(f, args);
+    else if (subcmd == "faults")
+      {
+        if (args->empty())
+          show_faults(f);
+        else if (args->pop() == "reset")
+          vm_ram()->fault_stats().reset();
+        else
+          argument_error("Invalid subcommand");
+      }
     else
       argument_error("Invalid subcommand");
   }
@@ -89,8 +99,53 @@ private:
     return true;
   }
 
+  void show_faults(FILE *f) const
+  {
+    using Vmm::Fault_stats;
+
+    static char const *const names[Fault_stats::Num_access]
+                                   [Fault_stats::Num_mappings] =
+      { { "read 4K", "read sp-req" }, { "write 4K", "write sp-req" } };
+
+    Fault_stats const &stats = vm_ram()->fault_stats();
+
+    fprintf(f, "Access           Faults    Avg us    Max us\n");
+    for (unsigned a = 0; a < Fault_stats::Num_access; ++a)
+      for (unsigned m = 0; m < Fault_stats::Num_mappings; ++m)
+        {
+          auto const &c = stats.counters(Fault_stats::Access(a),
+                                         Fault_stats::Mapping(m));
+          l4_uint64_t faults = c.faults;
+          fprintf(f, "%-12s %10llu %9llu %9llu\n", names[a][m], faults,
+                  faults ? c.total_ns / faults / 1000 : 0ULL,
+                  c.max_ns / 1000);
+        }
+
+    fprintf(f, "sp-req: superpage requested, the kernel may map less\n");
+
+    fprintf(f, "\nLatency histogram (faults below the given us)\n%-12s",
+            "Access");
+    for (unsigned b = 0; b < Fault_stats::Num_buckets - 1; ++b)
+      fprintf(f, " %6lu", 1UL << b);
+    fprintf(f, "  above\n");
+
+    for (unsigned a = 0; a < Fault_stats::Num_access; ++a)
+      for (unsigned m = 0; m < Fault_stats::Num_mappings; ++m)
+        {
+          auto const &c = stats.counters(Fault_stats::Access(a),
+                                         Fault_stats::Mapping(m));
+          fprintf(f, "%-12s", names[a][m]);
+          for (auto const &b : c.buckets)
+            fprintf(f, " %6llu", static_cast<l4_uint64_t>(b));
+          fprintf(f, "\n");
+        }
+  }
+
   T const *vm_ram() const
   { return static_cast<T const *>(this); }
+
+  T *vm_ram()
+  { return static_cast<T *>(this); }
 };
 
 }
@@ -123,4 +123,24 @@ Ram_ds::load_file(L4::Cap<L4Re::Dataspace> const &file,
     }
 }
 
+void
+Ram_ds::merge_file(L4::Cap<L4Re::Dataspace> const &file,
+                   Vmm::Guest_addr addr, l4_size_t sz)
+{
+  Dbg info(Dbg::Mmio, Dbg::Info, "file");
+
+  l4_addr_t offset = addr - _vm_start + this->offset();
+  if (offset & ~L4_PAGEMASK)
+    {
+      info.printf("merge: 0x%lx not page aligned, skipped\n", addr.get());
+      return;
+    }
+
+  long r = dataspace()->merge(offset, file, 0, l4_trunc_page(sz));
+  if (r < 0)
+    info.printf("merge: not supported by RAM provider (%ld)\n", r);
+  else
+    info.printf("merge: %ld of %zu bytes shared\n", r, sz);
+}
+
 } // namespace
@@ -74,6 +74,21 @@ public:
   void load_file(L4::Cap<L4Re::Dataspace> const &file,
                  Vmm::Guest_addr addr, l4_size_t sz);
 
+  /**
+   * Let the provider of the RAM share a range loaded from a dataspace.
+   *
+   * \param file  Dataspace the range was loaded from.
+   * \param addr  Guest physical address the data space was loaded to.
+   * \param sz    Number of bytes loaded.
+   *
+   * The provider may share the pages of the range with the pages of other
+   * guests that were loaded from the same dataspace. Shared pages are
+   * copy-on-write, so the contents of the guest RAM do not change. Only whole
+   * pages are shared, and only if the range starts at a page boundary.
+   */
+  void merge_file(L4::Cap<L4Re::Dataspace> const &file,
+                  Vmm::Guest_addr addr, l4_size_t sz);
+
   /**
    * Get a VMM-virtual pointer from a guest-physical address
    */
@@ -145,6 +145,7 @@ Vmm::Vm_ram::add_memory_region(L4::Cap<L4Re::Dataspace> ds, Vmm::Guest_addr base
     return -1;
 
   auto dsdev = Vdev::make_device<Ds_handler>(r, L4_FPAGE_RWX);
+  dsdev->fault_stats(&_fault_stats);
   memmap->add_mmio_device(Region::ss(r->vm_start(), r->size(), Region_type::Ram),
                           std::move(dsdev));
 
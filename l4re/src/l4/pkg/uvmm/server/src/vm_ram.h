@@ -22,6 +22,7 @@
 
 #include "device.h"
 #include "ds_mmio_mapper.h"
+#include "fault_stats.h"
 #include "host_dt.h"
 #include "mem_types.h"
 #include "ram_ds.h"
@@ -73,9 +74,17 @@ class Vm_ram
 public:
   Vm_ram(l4_addr_t boot_offset)
   : _boot_offset(boot_offset),
-    _as_mgr(Vdev::make_device<Vmm::Address_space_manager>())
+    _as_mgr(Vdev::make_device<Vmm::Address_space_manager>()),
+    _merge_files(false)
   {}
 
+  /**
+   * Let the provider of the RAM share files loaded into the RAM with other
+   * guests that loaded the same files (see Ram_ds::merge_file()).
+   */
+  void merge_files(bool enable)
+  { _merge_files = enable; }
+
   /**
    * Load the contents of the given dataspace into guest RAM.
    *
@@ -91,6 +100,8 @@ public:
       L4Re::chksys(-L4_ENOENT, "Guest region found");
 
     r->load_file(file, addr, sz);
+    if (_merge_files)
+      r->merge_file(file, addr, sz);
   }
 
   /**
@@ -180,6 +191,33 @@ public:
                  "Copying from dataspace into guest RAM.");
   }
 
+  /**
+   * Return a range of guest RAM to the provider of its dataspace.
+   *
+   * \param gp_addr  Guest physical start address of the range.
+   * \param size     Size of the range in bytes.
+   *
+   * The content of the range is lost, subsequent guest accesses observe
+   * zero-filled memory. Whether the memory is actually returned to the system
+   * depends on the dataspace implementation.
+   *
+   * \retval L4_EOK     Success.
+   * \retval -L4_ERANGE Range not completely contained in one RAM region.
+   */
+  long release(Vmm::Guest_addr gp_addr, l4_size_t size) const
+  {
+    auto r = find_region(gp_addr, size);
+    if (!r)
+      return -L4_ERANGE;
+
+    long err = r->ds()->clear(r->ds_offset() + (gp_addr - r->vm_start()),
+                              size);
+    if (err < 0)
+      return err;
+
+    return L4_EOK;
+  }
+
   template<typename FUNC>
   void foreach_region(FUNC &&func) const
   {
@@ -189,6 +227,12 @@ public:
 
   Vmm::Address_space_manager *as_mgr() const { return _as_mgr.get(); }
 
+  /**
+   * Statistics on the guest faults on RAM of all regions.
+   */
+  Fault_stats &fault_stats() { return _fault_stats; }
+  Fault_stats const &fault_stats() const { return _fault_stats; }
+
   Vmm::Address_space_manager_mode_if const *as_mgr_if() const
   { return static_cast<Vmm::Address_space_manager_mode_if *>(_as_mgr.get()); }
 
@@ -226,6 +270,8 @@ private:
   std::vector<cxx::Ref_ptr<Vmm::Ram_ds>> _regions;
   l4_addr_t _boot_offset;
   cxx::Ref_ptr<Vmm::Address_space_manager> _as_mgr;
+  bool _merge_files;
+  Fault_stats _fault_stats;
 };
 
 }
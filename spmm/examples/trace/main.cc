@@ -0,0 +1,100 @@
+#include <l4/re/dataspace>
+#include <l4/re/env>
+#include <l4/re/error_helper>
+#include <l4/re/util/cap_alloc>
+#include <l4/spmm/statistics>
+#include <l4/spmm/trace.h>
+#include <l4/util/util.h>
+
+#include <cstdio>
+#include <vector>
+
+using L4Re::chkcap;
+using L4Re::chksys;
+
+// drain the trace buffer of the SPMM (see l4/spmm/trace.h) once per second and
+// print its events as CSV, as well as the number of events that the SPMM had
+// to drop meanwhile. the SPMM has to provide its "spmm_statistics" capability.
+
+static char const *event_name(l4_uint32_t type)
+{
+  static char const *const names[] =
+    { "worker_spawn", "worker_scan", "worker_sleep", "merge", "unmerge",
+      "fault", "report_pages", "report_scans", "report_kmem",
+      "report_faults" };
+  if (type >= sizeof(names) / sizeof(names[0]))
+    return "unknown";
+  return names[type];
+}
+
+static void drain(l4spmm_trace_t *trace, unsigned idx, l4_uint64_t *dropped)
+{
+  l4spmm_trace_ring_t *ring = l4spmm_trace_ring(trace, idx);
+  l4spmm_trace_event_t const *events = l4spmm_trace_events(ring);
+
+  // the SPMM publishes events by advancing head, after it wrote them.
+  l4_uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  l4_uint64_t tail = ring->tail;
+  for (; tail != head; tail++)
+  {
+    l4spmm_trace_event_t const &e = events[tail & (trace->ring_size - 1)];
+    printf("%llu, %u, %s, %d, %llu, %llu\n", e.time, idx, event_name(e.type),
+           static_cast<int>(e.client), e.arg0, e.arg1);
+  }
+
+  // hand the consumed events back to the SPMM.
+  __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+  l4_uint64_t now_dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+  if (now_dropped != *dropped)
+  {
+    printf("ring %u dropped %llu events\n", idx, now_dropped - *dropped);
+    *dropped = now_dropped;
+  }
+}
+
+int main(void)
+{
+  L4Re::Env const *env = L4Re::Env::env();
+  L4::Cap<Spmm::Stats> stats;
+
+  // get statistics interface from SPMM.
+  stats = env->get_cap<Spmm::Stats>("spmm_statistics");
+  chkcap(stats, "spmm_statistics not valid");
+
+  // obtain trace buffer. it is attached writable, as the tails are ours.
+  L4::Cap<L4Re::Dataspace> ds;
+  ds = chkcap(L4Re::Util::cap_alloc.alloc<L4Re::Dataspace>(),
+              "trace cap alloc");
+  chksys(stats->trace_buffer(ds), "obtain trace buffer");
+
+  l4_addr_t addr = 0;
+  l4_size_t size = ds->size();
+  L4Re::Rm::Flags rm_flags = L4Re::Rm::F::RW | L4Re::Rm::F::Search_addr;
+  chksys(env->rm()->attach(&addr, size, rm_flags, ds),
+         "trace buffer as attach");
+
+  l4spmm_trace_t *trace = reinterpret_cast<l4spmm_trace_t *>(addr);
+  if (trace->magic != L4SPMM_TRACE_MAGIC
+      || trace->version != L4SPMM_TRACE_VERSION)
+  {
+    printf("unknown trace buffer format\n");
+    return 1;
+  }
+
+  printf("obtained trace buffer [addr: 0x%08lX, size: %ld bytes, rings: %u]\n",
+         addr, size, trace->max_rings);
+
+  // events that the SPMM dropped so far, per ring.
+  std::vector<l4_uint64_t> dropped(trace->max_rings, 0);
+
+  printf("time_ns, ring, event, client, arg0, arg1\n");
+  while (true)
+  {
+    for (unsigned i = 0; i < trace->max_rings; i++)
+      drain(trace, i, &dropped[i]);
+    l4_sleep(1000);
+  }
+
+  return 0;
+}
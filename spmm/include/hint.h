@@ -0,0 +1,54 @@
+#pragma once
+
+#include <l4/sys/l4int.h>
+
+/**
+ * Cooperative same-page merging hints.
+ *
+ * The SPMM provides a virtio device through which a guest can report ranges of
+ * its memory that are good or bad candidates for same-page merging. The device
+ * uses a single virtqueue. Every request consists of device-readable buffers
+ * that contain an array of l4spmm_hint_t entries. The addresses of the entries
+ * are guest-physical addresses within the guest RAM that the SPMM provides.
+ *
+ * The device processes the hints of a request before it returns the request in
+ * the used ring. The guest must not reuse memory that it reported as free
+ * until then, as its content may be dropped at any point before. Zero-filled
+ * ranges may be written to at any time, the SPMM only drops pages that are
+ * still zero-filled.
+ *
+ * A hint device is obtained by calling the create function of the SPMM
+ * allocator with the L4VIRTIO_PROTOCOL, for example from ned:
+ *
+ *   spmm_channel:create(0);
+ */
+
+/**
+ * Device ID of the SPMM hint device (unofficial).
+ */
+enum { L4VIRTIO_ID_SPMM_HINT = 0x5350 };
+
+/**
+ * Types of same-page merging hints.
+ */
+enum l4spmm_hint_type
+{
+  /// The range holds content that is not going to change (e.g. kernel text).
+  /// The SPMM scans such pages with high priority.
+  L4SPMM_HINT_READ_ONLY = 0,
+  /// The range is not used by the guest. The SPMM drops its content.
+  L4SPMM_HINT_FREE      = 1,
+  /// The range is zero-filled. The SPMM merges it without scanning it.
+  L4SPMM_HINT_ZERO      = 2,
+};
+
+/**
+ * A single same-page merging hint.
+ */
+typedef struct l4spmm_hint_t
+{
+  l4_uint64_t addr; ///< guest-physical start address of the range.
+  l4_uint64_t size; ///< size of the range in bytes.
+  l4_uint32_t type; ///< type of the hint, see l4spmm_hint_type.
+  l4_uint32_t reserved;
+} l4spmm_hint_t;
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <l4/sys/compiler.h>
+#include <l4/sys/l4int.h>
+
+/**
+ * Binary event trace of the SPMM.
+ *
+ * The SPMM records timestamped events (e.g. merges and unmerges of pages) into
+ * a trace buffer, without locking and without any IPC. The trace buffer is a
+ * dataspace that is obtained through the Spmm::Stats interface (see
+ * Spmm::Stats::trace_buffer) and consists of an l4spmm_trace_t header that is
+ * followed by max_rings rings of events.
+ *
+ * Every thread of the SPMM writes into a ring of its own. A ring is a single
+ * producer, single consumer queue: the SPMM advances head after it wrote an
+ * event, the reader advances tail after it consumed one. Events that do not fit
+ * into a full ring are dropped and counted. Events are written at
+ * events[head % ring_size].
+ *
+ * The SPMM also reports its counters every few seconds as a group of
+ * L4SPMM_TRACE_REPORT_* events. The spmm-trace example drains the trace buffer
+ * and prints its events.
+ */
+
+enum
+{
+  L4SPMM_TRACE_MAGIC   = 0x544d5053, ///< "SPMT"
+  L4SPMM_TRACE_VERSION = 1,
+};
+
+/**
+ * Types of trace events.
+ */
+enum l4spmm_trace_event_type
+{
+  /// The worker started. No arguments.
+  L4SPMM_TRACE_WORKER_SPAWN = 0,
+  /// The worker starts a pass. arg0: maximum number of pages to scan.
+  L4SPMM_TRACE_WORKER_SCAN  = 1,
+  /// The worker finished a pass. arg0: number of pages scanned.
+  L4SPMM_TRACE_WORKER_SLEEP = 2,
+  /// A page has been merged. arg0: page, arg1: immutable page it shares.
+  L4SPMM_TRACE_MERGE        = 3,
+  /// A page has been unmerged. arg0: page, arg1: immutable page it shared.
+  L4SPMM_TRACE_UNMERGE      = 4,
+  /// A page fault of a client has been served. arg0: latency in microseconds.
+  L4SPMM_TRACE_FAULT        = 5,
+  /// Periodic report, first event. arg0: immutable pages in use (shared),
+  /// arg1: pages that share them (sharing).
+  L4SPMM_TRACE_REPORT_PAGES  = 6,
+  /// Periodic report. arg0: volatile pages (unshared), arg1: full scans.
+  L4SPMM_TRACE_REPORT_SCANS  = 7,
+  /// Periodic report. arg0: kernel memory in use in KiB, arg1: its
+  /// high-water mark in KiB. Both are 0 if the kernel does not report them.
+  L4SPMM_TRACE_REPORT_KMEM   = 8,
+  /// Periodic report, last event. arg0: page faults served since the previous
+  /// report, arg1: their total latency in microseconds.
+  L4SPMM_TRACE_REPORT_FAULTS = 9,
+};
+
+/**
+ * A single trace event.
+ */
+typedef struct l4spmm_trace_event_t
+{
+  l4_uint64_t time;   ///< KIP clock in nanoseconds.
+  l4_uint32_t type;   ///< type of the event, see l4spmm_trace_event_type.
+  l4_uint32_t client; ///< client the event belongs to, ~0U if none.
+  l4_uint64_t arg0;   ///< first argument, depending on the type.
+  l4_uint64_t arg1;   ///< second argument, depending on the type.
+} l4spmm_trace_event_t;
+
+/**
+ * Ring of trace events of a single thread.
+ *
+ * The counters reside in cache lines of their own, as they are written by
+ * different parties.
+ */
+typedef struct l4spmm_trace_ring_t
+{
+  l4_uint64_t head;     ///< events written, only advanced by the SPMM.
+  l4_uint64_t _pad0[7];
+  l4_uint64_t tail;     ///< events consumed, only advanced by the reader.
+  l4_uint64_t _pad1[7];
+  l4_uint64_t dropped;  ///< events dropped because the ring was full.
+  l4_uint64_t _pad2[7];
+} l4spmm_trace_ring_t;
+
+/**
+ * Header of the trace buffer.
+ */
+typedef struct l4spmm_trace_t
+{
+  l4_uint32_t magic;       ///< L4SPMM_TRACE_MAGIC.
+  l4_uint32_t version;     ///< L4SPMM_TRACE_VERSION.
+  l4_uint32_t max_rings;   ///< number of rings in the trace buffer.
+  l4_uint32_t ring_size;   ///< events per ring, a power of two.
+  l4_uint64_t ring_offset; ///< offset of the first ring in the trace buffer.
+  l4_uint64_t ring_stride; ///< distance between two rings in bytes.
+} l4spmm_trace_t;
+
+/**
+ * Retrieve a ring of a trace buffer.
+ *
+ * @param trace  The header of the trace buffer.
+ * @param idx    Index of the ring, smaller than trace->max_rings.
+ *
+ * @returns      The ring. Its events follow directly after it.
+ */
+L4_INLINE l4spmm_trace_ring_t *
+l4spmm_trace_ring(l4spmm_trace_t *trace, unsigned idx)
+{
+  return (l4spmm_trace_ring_t *)((char *)trace + trace->ring_offset
+                                 + idx * trace->ring_stride);
+}
+
+/**
+ * Retrieve the events of a ring.
+ *
+ * @param ring  The ring.
+ *
+ * @returns     The array of ring_size events of the ring.
+ */
+L4_INLINE l4spmm_trace_event_t *
+l4spmm_trace_events(l4spmm_trace_ring_t *ring)
+{
+  return (l4spmm_trace_event_t *)(ring + 1);
+}
@@ -7,6 +7,7 @@
 
 #include "dataspace.h"
 #include "manager.h"
+#include "policy.h"
 
 extern L4Re::Util::Registry_server<L4Re::Util::Br_manager_hooks> server;
 
@@ -51,6 +52,9 @@ public:
    *              of where the new page is going to be mapped to. This might
    *              enable allocation strategy-specific optimizations, but
    *              allocators should not rely on this information.
+   *              For immutable pages, this is the address of one of the pages
+   *              that are going to share it, which allows allocators to place
+   *              the page close to its sharers (see get_node()).
    *              Should be 0 otherwise.
    *
    * @returns     The newly allocated page.
@@ -64,6 +68,79 @@ public:
    * @param page  The page that should be returned.
    */
   virtual void free_page(AllocatorFlags flags, page_t page) = 0;
+
+  /**
+   * Retrieve the merge policy of the client that a page belongs to.
+   *
+   * @param page  The page of interest.
+   *
+   * @returns     The policy of the client that owns the page, or nullptr if the
+   *              page does not belong to a client of this allocator.
+   */
+  virtual Policy const *get_policy(page_t page) = 0;
+
+  /**
+   * Check whether the policy of a client permits merging one of its pages.
+   *
+   * @param page  The page that is about to be merged.
+   * @param pages Number of pages of the same client that the merge adds,
+   *              including the page itself (e.g. 2 for a merge of two pages
+   *              of the same client).
+   *
+   * @returns     True if the page may be merged.
+   *
+   * Allocators account for the pages of every client that are currently
+   * merged (i.e. that have been returned to them as volatile pages) in order to
+   * enforce the maximum shared-page share of the client.
+   */
+  virtual bool may_merge_page(page_t page, unsigned pages = 1) = 0;
+
+  /**
+   * Retrieve the memory node (e.g. CPU cluster) that a page is associated
+   * with.
+   *
+   * @param page  The page of interest.
+   *
+   * @returns     For immutable pages, the node of the pool that the page was
+   *              allocated from. For client pages, the node that the client
+   *              runs on. Spmm::Policy::Any_node if the page is not bound to
+   *              any node.
+   */
+  virtual unsigned get_node(page_t page) = 0;
+
+  /**
+   * Check whether an immutable page that is bound to a memory node can be
+   * allocated.
+   *
+   * @param node  The memory node of interest, or Spmm::Policy::Any_node for
+   *              any memory node.
+   *
+   * @returns     True if a pool of immutable pages that is bound to the node
+   *              has a free page left. False if there is no such pool.
+   */
+  virtual bool has_node_page(unsigned node) = 0;
+
+  /**
+   * Retrieve the client that a page belongs to.
+   *
+   * @param page  The page of interest.
+   *
+   * @returns     The client that owns the page, or Spmm::invalid_client if the
+   *              page does not belong to a client of this allocator.
+   */
+  virtual client_t get_client(page_t page) = 0;
+
+  /**
+   * Retrieve the page at an offset within a dataspace that this allocator
+   * handed out.
+   *
+   * @param ds      Capability to the dataspace, as received from a client.
+   * @param offset  Offset within the dataspace.
+   *
+   * @returns       The page, or 0 if the dataspace was not handed out by this
+   *                allocator or the offset lies outside of it.
+   */
+  virtual page_t get_page(L4::Cap<L4Re::Dataspace> ds, l4_addr_t offset) = 0;
 };
 
 struct AllocatorFlags : L4::Types::Flags_ops_t<AllocatorFlags>
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <l4/re/env>
+#include <l4/re/error_helper>
+#include <l4/re/util/cap_alloc>
+
+#include <list>
+#include <mutex>
+#include <vector>
+
+using L4Re::chkcap;
+using L4Re::chksys;
+
+namespace Spmm
+{
+
+// a simple helper class that provides memory at page granular sizes from a
+// few large dataspaces (arenas), instead of one region per allocation.
+//
+// every arena is carved into blocks of one size class (a power of two number
+// of pages). freed blocks go back to the free list of their arena and are
+// reused for allocations of the same size class. once an arena becomes
+// empty, its memory is returned to the system with L4Re::Dataspace::clear().
+// requests larger than an arena get an arena of their own, which is released
+// completely when it is freed.
+class ArenaAllocator
+{
+  enum
+  {
+    Arena_shift = 21,
+    Arena_size  = 1UL << Arena_shift,
+    // size classes range from one page to a whole arena.
+    Num_classes = Arena_shift - L4_PAGESHIFT + 1,
+    // number of empty arenas per size class that are kept attached.
+    Max_empty   = 1,
+  };
+
+  struct arena_t
+  {
+    L4::Cap<L4Re::Dataspace> ds_cap;
+    l4_addr_t start;
+    l4_size_t size;
+    l4_size_t block_size;
+    // free blocks that have been carved out before, most recent last.
+    std::vector<l4_addr_t> free_blocks;
+    // offset of the first block that has never been carved out.
+    l4_addr_t carve_offset;
+    l4_size_t blocks_in_use;
+
+    bool contains(l4_addr_t addr) const
+    { return (start <= addr) && (addr - start < size); }
+
+    bool has_free_block(void) const
+    { return !free_blocks.empty() || carve_offset < size; }
+  };
+
+  typedef std::list<arena_t> arena_list_t;
+private:
+  // arenas per size class, arenas for large requests last.
+  arena_list_t _arenas[Num_classes + 1];
+  std::mutex _mutex;
+
+  static unsigned _size_class(l4_size_t size)
+  {
+    unsigned cls = 0;
+    while ((L4_PAGESIZE << cls) < size)
+      cls++;
+    return cls;
+  }
+
+  arena_t &_create_arena(unsigned cls, l4_size_t arena_size,
+                         l4_size_t block_size)
+  {
+    L4Re::Env const *env = L4Re::Env::env();
+    arena_t arena;
+    arena.ds_cap = chkcap(L4Re::Util::cap_alloc.alloc<L4Re::Dataspace>(),
+                          "arena cap alloc");
+    chksys(env->mem_alloc()->alloc(arena_size, arena.ds_cap),
+           "arena mem alloc");
+
+    arena.start = 0;
+    L4Re::Rm::Flags rm_flags = L4Re::Rm::F::RWX | L4Re::Rm::F::Search_addr;
+    chksys(env->rm()->attach(&arena.start, arena_size, rm_flags,
+                             L4::Ipc::make_cap_rw(arena.ds_cap),
+                             0, Arena_shift),
+           "arena as attach");
+
+    arena.size = arena_size;
+    arena.block_size = block_size;
+    arena.carve_offset = 0;
+    arena.blocks_in_use = 0;
+    _arenas[cls].push_back(arena);
+    return _arenas[cls].back();
+  }
+
+  void _destroy_arena(unsigned cls, arena_list_t::iterator arena)
+  {
+    L4Re::Env const *env = L4Re::Env::env();
+    chksys(env->rm()->detach(arena->start, 0), "arena as detach");
+    L4Re::Util::cap_alloc.free(arena->ds_cap, env->task().cap());
+    _arenas[cls].erase(arena);
+  }
+
+  arena_list_t::iterator _find_arena(l4_addr_t addr, unsigned *cls)
+  {
+    for (*cls = 0; *cls <= Num_classes; (*cls)++)
+      for (auto it = _arenas[*cls].begin(); it != _arenas[*cls].end(); it++)
+        if (it->contains(addr))
+          return it;
+    // fallthrough.
+    chksys(-L4_EINVAL, "arena of block not found");
+    return _arenas[Num_classes].end();
+  }
+
+public:
+  ~ArenaAllocator()
+  {
+    for (unsigned cls = 0; cls <= Num_classes; cls++)
+      while (!_arenas[cls].empty())
+        _destroy_arena(cls, _arenas[cls].begin());
+  }
+
+  /**
+   * Allocate memory.
+   *
+   * @param size  Size of the memory, rounded up to a power of two number of
+   *              pages.
+   *
+   * @returns     Start address of the memory. Memory that has been freed
+   *              before is not cleared.
+   */
+  l4_addr_t allocate(l4_size_t size)
+  {
+    std::lock_guard<std::mutex> const lock(_mutex);
+
+    // large requests get an arena of their own.
+    if (size > Arena_size)
+    {
+      size = l4_round_size(size, Arena_shift);
+      arena_t &arena = _create_arena(Num_classes, size, size);
+      arena.carve_offset = size;
+      arena.blocks_in_use = 1;
+      return arena.start;
+    }
+
+    // take a block from the first arena of the size class that has one.
+    unsigned cls = _size_class(size);
+    arena_t *arena = nullptr;
+    for (arena_t &a : _arenas[cls])
+      if (a.has_free_block())
+      {
+        arena = &a;
+        break;
+      }
+    if (!arena)
+      arena = &_create_arena(cls, Arena_size, L4_PAGESIZE << cls);
+
+    l4_addr_t block;
+    if (!arena->free_blocks.empty())
+    {
+      block = arena->free_blocks.back();
+      arena->free_blocks.pop_back();
+    }
+    else
+    {
+      block = arena->start + arena->carve_offset;
+      arena->carve_offset += arena->block_size;
+    }
+    arena->blocks_in_use++;
+    return block;
+  }
+
+  /**
+   * Free memory.
+   *
+   * @param addr  Start address of the memory, as returned by allocate().
+   */
+  void free(l4_addr_t addr)
+  {
+    std::lock_guard<std::mutex> const lock(_mutex);
+
+    unsigned cls;
+    arena_list_t::iterator arena = _find_arena(addr, &cls);
+    if (cls == Num_classes)
+    {
+      _destroy_arena(cls, arena);
+      return;
+    }
+
+    arena->free_blocks.push_back(addr);
+    if (--arena->blocks_in_use)
+      return;
+
+    // the arena is empty: return its memory to the system, and forget about
+    // it completely if there are enough empty arenas of this class already.
+    unsigned num_empty = 0;
+    for (arena_t const &a : _arenas[cls])
+      if (!a.blocks_in_use)
+        num_empty++;
+    if (num_empty > Max_empty)
+    {
+      _destroy_arena(cls, arena);
+      return;
+    }
+
+    chksys(arena->ds_cap->clear(0, arena->size), "arena clear");
+    arena->free_blocks.clear();
+    arena->carve_offset = 0;
+  }
+
+  /**
+   * Return the memory behind a part of an allocation to the system, without
+   * freeing the allocation. The part reads as zero-filled afterwards.
+   *
+   * @param addr  Start address of the part, page aligned.
+   * @param size  Size of the part, a multiple of the page size.
+   */
+  void clear(l4_addr_t addr, l4_size_t size)
+  {
+    std::lock_guard<std::mutex> const lock(_mutex);
+
+    unsigned cls;
+    arena_list_t::iterator arena = _find_arena(addr, &cls);
+    chksys(arena->ds_cap->clear(addr - arena->start, size), "arena clear");
+  }
+};
+
+} //Spmm
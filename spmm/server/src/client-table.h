@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+
+#include "manager.h"
+
+namespace Spmm
+{
+
+// a simple helper class that keeps per-client entries of an allocator
+// component, indexed by client.
+//
+// a single thread adds entries (the one that serves the allocator), while the
+// threads that serve the clients, the worker and other helper threads look
+// them up concurrently. entries are never removed and never move, so a new
+// entry only has to be published: it is written completely before the size is
+// increased, and readers never look beyond the size they observed.
+template <typename T, unsigned N>
+class ClientTable
+{
+private:
+  T _entries[N];
+  std::atomic<unsigned> _size = 0;
+
+public:
+  unsigned size(void) const { return _size.load(std::memory_order_acquire); }
+
+  bool full(void) const
+  { return _size.load(std::memory_order_relaxed) == N; }
+
+  T &operator[](client_t client) { return _entries[client]; }
+
+  /**
+   * Add an entry, only ever called by a single thread.
+   *
+   * @param entry  The entry. The table must not be full.
+   *
+   * @returns      The client that the entry belongs to.
+   */
+  client_t add(T const &entry)
+  {
+    unsigned size = _size.load(std::memory_order_relaxed);
+    _entries[size] = entry;
+    _size.store(size + 1, std::memory_order_release);
+    return size;
+  }
+
+  T *begin(void) { return _entries; }
+  T *end(void) { return _entries + size(); }
+};
+
+} //Spmm
@@ -1,9 +1,21 @@
+#include <l4/cxx/minmax>
+#include <l4/re/env.h>
+#include <l4/sys/task>
+#include <l4/sys/kip.h>
+
+#include <cstring>
+
 #include "dataspace.h"
 
 namespace Spmm {
 
+std::vector<L4::Cap<L4Re::Dataspace>> Dataspace::_sources;
+std::mutex Dataspace::_sources_mutex;
+
 Dataspace::Dataspace(l4_addr_t mem_start, l4_size_t mem_size,
-                     L4Re::Dataspace::Flags mem_flags, Spmm::Manager *manager)
+                     L4Re::Dataspace::Flags mem_flags, Spmm::Manager *manager,
+                     client_t client, Policy const &policy)
+  : _client(client), _policy(policy)
 {
   _ds_start    = mem_start;
   _ds_size     = mem_size;
@@ -22,7 +34,13 @@ Dataspace::map_hook(L4Re::Dataspace::Offset offs, L4Re::Dataspace::Flags flags,
   L4Re::Dataspace::Flags w_or_x = L4Re::Dataspace::F::W | L4Re::Dataspace::F::X;
   if (flags & w_or_x)
   {
+    // most faults hit unmerged pages, which need no lock. a page that is
+    // merged right after this check is mapped read-only into the SPMM, so the
+    // client can only map it read-only and faults again.
     page_t page = l4_trunc_page(_ds_start + offs);
+    if (!manager->is_merged_page(this, page))
+      return L4_EOK;
+
     manager->lock_page(this, page);
     // unmerge page if currently merged.
     if (manager->is_merged_page(this, page))
@@ -32,4 +50,117 @@ Dataspace::map_hook(L4Re::Dataspace::Offset offs, L4Re::Dataspace::Flags flags,
   return L4_EOK;
 }
 
+bool
+Dataspace::map_around_hook(L4Re::Dataspace::Offset offs,
+                           L4Re::Dataspace::Flags flags)
+{
+  // read-only mappings of merged pages do no harm.
+  if (!flags.w())
+    return true;
+
+  // the answer is only a hint, see map_hook(). no page lock needed.
+  page_t page = l4_trunc_page(_ds_start + offs);
+  return !manager->is_merged_page(this, page);
+}
+
+long
+Dataspace::op_map(L4Re::Dataspace::Rights rights,
+                  L4Re::Dataspace::Offset offset,
+                  L4Re::Dataspace::Map_addr spot, L4Re::Dataspace::Flags flags,
+                  L4Re::Snd_fpages &fp)
+{
+  l4_cpu_time_t start = l4_kip_clock(l4re_kip());
+  long ret = Dataspace_svr::op_map(rights, offset, spot, flags, fp);
+  manager->add_fault(this, _client, l4_kip_clock(l4re_kip()) - start);
+  return ret;
+}
+
+l4_uint64_t
+Dataspace::_source_id(L4::Cap<L4Re::Dataspace> src)
+{
+  std::lock_guard<std::mutex> const lock(_sources_mutex);
+
+  // clients refer to the same source through different capabilities.
+  L4::Cap<L4::Task> const task = L4Re::Env::env()->task();
+  for (l4_uint64_t id = 0; id < _sources.size(); id++)
+    if (task->cap_equal(_sources[id], src).label())
+      return id;
+
+  // keep the capability of a new source to compare later requests with it.
+  L4::Ipc_svr::Server_iface *iface = server_iface();
+  L4Re::chksys(iface->realloc_rcv_cap(0), "realloc merge source cap");
+  _sources.push_back(src);
+  return _sources.size() - 1;
+}
+
+long
+Dataspace::op_merge(L4Re::Dataspace::Rights rights,
+                    L4Re::Dataspace::Offset dst_offs,
+                    L4::Ipc::Snd_fpage const &src_cap,
+                    L4Re::Dataspace::Offset src_offs,
+                    L4Re::Dataspace::Size size)
+{
+  if (!src_cap.cap_received())
+    return -L4_EINVAL;
+
+  if (!(rights & L4_CAP_FPAGE_W))
+    return -L4_EACCESS;
+
+  if ((dst_offs | src_offs | size) & (L4_PAGESIZE - 1))
+    return -L4_EINVAL;
+
+  if (dst_offs >= _ds_size || size > _ds_size - dst_offs)
+    return -L4_ERANGE;
+
+  l4_uint64_t source;
+  source = _source_id(server_iface()->rcv_cap<L4Re::Dataspace>(0));
+
+  L4Re::Dataspace::Size merged = 0;
+  for (l4_addr_t offs = 0; offs < size; offs += L4_PAGESIZE)
+  {
+    page_t page = _ds_start + dst_offs + offs;
+    manager->lock_page(this, page);
+    if (manager->merge_loaded_page(this, page, source, src_offs + offs))
+      merged += L4_PAGESIZE;
+    manager->unlock_page(this, page);
+  }
+
+  return merged;
+}
+
+long
+Dataspace::clear(unsigned long offs, unsigned long size) const noexcept
+{
+  if (!check_limit(offs))
+    return -L4_ERANGE;
+
+  // the interface of Dataspace_svr is const, the manager interface is not.
+  Component *self = const_cast<Dataspace *>(this);
+
+  size = cxx::min(size, round_size() - offs);
+  l4_addr_t start = _ds_start + offs;
+  l4_addr_t end = start + size;
+
+  for (page_t page = l4_trunc_page(start); page < end; page += L4_PAGESIZE)
+  {
+    l4_addr_t from = cxx::max(page, start);
+    l4_addr_t to = cxx::min(page + L4_PAGESIZE, end);
+
+    manager->lock_page(self, page);
+    // discard whole pages (merged or not), zero partial pages (or if
+    // discarding is refused).
+    bool whole = (to - from == L4_PAGESIZE);
+    if (!whole || manager->discard_page(self, page) != L4_EOK)
+    {
+      // merged pages are mapped read-only and have to be unmerged first.
+      if (manager->is_merged_page(self, page))
+        manager->unmerge_page(self, page);
+      memset(reinterpret_cast<void *>(from), 0, to - from);
+    }
+    manager->unlock_page(self, page);
+  }
+
+  return size;
+}
+
 } //Spmm
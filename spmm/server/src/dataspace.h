@@ -5,7 +5,12 @@
 #include <l4/re/util/dataspace_svr>
 #include <l4/sys/cxx/ipc_epiface>
 
+#include <atomic>
+#include <mutex>
+#include <vector>
+
 #include "manager.h"
+#include "policy.h"
 
 namespace Spmm
 {
@@ -19,7 +24,8 @@ class Dataspace : public Component,
 {
 public:
   Dataspace(l4_addr_t mem_start, l4_size_t mem_size,
-            L4Re::Dataspace::Flags mem_flags, Spmm::Manager *manager);
+            L4Re::Dataspace::Flags mem_flags, Spmm::Manager *manager,
+            client_t client, Policy const &policy = Policy());
 
   /**
    * See L4Re::Util::Dataspace_svr::map_hook
@@ -27,6 +33,120 @@ public:
   int map_hook(L4Re::Dataspace::Offset offs, L4Re::Dataspace::Flags flags,
                L4Re::Dataspace::Map_addr min,
                L4Re::Dataspace::Map_addr max) override;
+
+  /**
+   * See L4Re::Util::Dataspace_svr::map_around_hook
+   *
+   * Merged pages are left out, they are mapped read-only and a write access
+   * has to fault in order to unmerge them.
+   */
+  bool map_around_hook(L4Re::Dataspace::Offset offs,
+                       L4Re::Dataspace::Flags flags) override;
+
+  /**
+   * See L4Re::Util::Dataspace_svr::fault_around_pages
+   *
+   * Configured by the policy of the client.
+   */
+  unsigned long fault_around_pages() const noexcept override
+  { return _policy.fault_around; }
+
+  /**
+   * See L4Re::Util::Dataspace_svr::clear
+   *
+   * Whole pages are discarded (see Spmm::Memory::discard_page) instead of
+   * being zeroed, which returns their backing memory to the system. This is
+   * the path that a VMM takes to release memory of its guest (e.g. pages
+   * that are handed to a memory balloon).
+   */
+  long clear(unsigned long offs, unsigned long size) const noexcept override;
+
+  /**
+   * See L4Re::Util::Dataspace_svr::op_map
+   *
+   * Additionally reports the time it took to serve the request.
+   */
+  long op_map(L4Re::Dataspace::Rights rights, L4Re::Dataspace::Offset offset,
+              L4Re::Dataspace::Map_addr spot, L4Re::Dataspace::Flags flags,
+              L4Re::Snd_fpages &fp);
+
+  /**
+   * See L4Re::Util::Dataspace_svr::op_merge
+   *
+   * The range of this dataspace has been loaded from the range of the source
+   * dataspace (e.g. a boot module). Its pages are merged right away with the
+   * pages of other clients that were loaded from the same source, as far as
+   * their contents still match (see Spmm::Worker::merge_loaded_page). The
+   * source is not accessed.
+   */
+  long op_merge(L4Re::Dataspace::Rights rights,
+                L4Re::Dataspace::Offset dst_offs,
+                L4::Ipc::Snd_fpage const &src_cap,
+                L4Re::Dataspace::Offset src_offs, L4Re::Dataspace::Size size);
+
+  /**
+   * Check whether a page is part of this dataspace.
+   *
+   * @param page  The page that should be checked.
+   *
+   * @returns     True if the page lies within this dataspace.
+   */
+  bool contains(page_t page) const
+  { return (_ds_start <= page) && (page - _ds_start < _ds_size); }
+
+  /**
+   * Retrieve the page at an offset within this dataspace.
+   *
+   * @param offset  Offset within this dataspace.
+   *
+   * @returns       The page, or 0 if the offset lies outside of this dataspace.
+   */
+  page_t page_at(l4_addr_t offset) const
+  { return (offset < _ds_size) ? l4_trunc_page(_ds_start + offset) : 0; }
+
+  /**
+   * The client of this dataspace.
+   */
+  client_t client(void) const { return _client; }
+
+  /**
+   * The merge policy of the client of this dataspace.
+   */
+  Policy const &policy(void) const { return _policy; }
+
+  /**
+   * Check whether the policy of this client permits merging further pages.
+   *
+   * @param pages  Number of pages of this client that the merge adds.
+   *
+   * @returns      True if merging is enabled for this client and its maximum
+   *               shared-page share is not exceeded by the merge.
+   */
+  bool may_merge_page(l4_size_t pages = 1) const
+  {
+    l4_size_t pages_total = _ds_size >> L4_PAGESHIFT;
+    return _policy.merge
+           && (_pages_merged + pages) * 100 <= _policy.max_share * pages_total;
+  }
+
+  /**
+   * Bookkeeping for the shared-page share of this client.
+   */
+  void inc_pages_merged(void) { _pages_merged++; }
+  void dec_pages_merged(void) { _pages_merged--; }
+
+private:
+  client_t  _client;
+  Policy    _policy;
+  // pages of different clients are merged and unmerged concurrently.
+  std::atomic<l4_size_t> _pages_merged = 0;
+
+  // sources of merge requests, identified by their index. dataspaces of
+  // different clients are served by different threads.
+  static std::vector<L4::Cap<L4Re::Dataspace>> _sources;
+  static std::mutex _sources_mutex;
+
+  l4_uint64_t _source_id(L4::Cap<L4Re::Dataspace> src);
 };
 
 } //Spmm
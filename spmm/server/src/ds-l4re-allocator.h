@@ -5,11 +5,20 @@
 #include <l4/re/util/cap_alloc>
 #include <l4/util/util.h>
 
+#include <pthread-l4.h>
+
+#include <condition_variable>
 #include <cstdio>
+#include <iterator>
 #include <list>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 #include "allocator.h"
+#include "client-table.h"
+#include "hint-device.h"
+#include "server-thread.h"
 
 using L4Re::chkcap;
 using L4Re::chksys;
@@ -20,6 +29,8 @@ namespace Spmm
 // a simple helper class that provides memory at page granular sizes.
 // it can serve as the pool of immutable memory pages for another allocator
 // component.
+// a pool can be bound to a memory node (e.g. a CPU cluster) by backing it with
+// a dataspace that covers memory close to this node.
 class PageAllocator
 {
   typedef std::vector<bool> bitmap_t;
@@ -27,38 +38,69 @@ private:
   friend class DsL4ReAllocator;
   L4::Cap<L4Re::Dataspace> _buffer_cap;
   l4_addr_t _buffer_addr;
+  l4_size_t _buffer_size;
   bitmap_t _free_pages;
+  l4_size_t _pages_free;
+  unsigned _node;
 
   PageAllocator(l4_size_t buffer_size_in_pages)
-    : _free_pages(buffer_size_in_pages, true)
+    : _buffer_size(buffer_size_in_pages << L4_PAGESHIFT),
+      _free_pages(buffer_size_in_pages, true),
+      _pages_free(buffer_size_in_pages),
+      _node(Policy::Any_node)
   {
     // allocate buffer of pages.
     L4Re::Env const *env = L4Re::Env::env();
     _buffer_cap = chkcap(L4Re::Util::cap_alloc.alloc<L4Re::Dataspace>(),
                         "buffer cap alloc");
-    l4_size_t buffer_size = buffer_size_in_pages << L4_PAGESHIFT;
-    chksys(env->mem_alloc()->alloc(buffer_size, _buffer_cap),
+    chksys(env->mem_alloc()->alloc(_buffer_size, _buffer_cap),
            "buffer mem alloc");
 
+    _attach_buffer();
+  };
+
+  PageAllocator(L4::Cap<L4Re::Dataspace> buffer_cap, unsigned node)
+    : _buffer_cap(buffer_cap),
+      _buffer_size(l4_trunc_page(buffer_cap->size())),
+      _free_pages(_buffer_size >> L4_PAGESHIFT, true),
+      _pages_free(_buffer_size >> L4_PAGESHIFT),
+      _node(node)
+  {
+    // use the provided buffer of pages.
+    _attach_buffer();
+  };
+
+  PageAllocator(PageAllocator const &pa) = delete;
+
+  void _attach_buffer(void)
+  {
     // prepare address space.
+    L4Re::Env const *env = L4Re::Env::env();
     _buffer_addr = 0;
     L4Re::Rm::Flags rm_flags = L4Re::Rm::F::RWX
                                | L4Re::Rm::F::Search_addr;
-    chksys(env->rm()->attach(&_buffer_addr, buffer_size, rm_flags, _buffer_cap),
+    chksys(env->rm()->attach(&_buffer_addr, _buffer_size, rm_flags,
+                             _buffer_cap),
            "buffer as attach");
 
-    l4_addr_t buffer_end_addr = _buffer_addr + buffer_size;
+    l4_addr_t buffer_end_addr = _buffer_addr + _buffer_size;
     L4Re::Dataspace::Flags ds_flags = L4Re::Dataspace::F::RWX;
     chksys(_buffer_cap->map_region(0, ds_flags, _buffer_addr, buffer_end_addr),
            "buffer mem map");
 
-    printf("initialised internal page pool [addr: 0x%08lX, size: %ld pages]\n",
-           _buffer_addr, buffer_size_in_pages);
-  };
-
-  PageAllocator(PageAllocator const &pa) = delete;
+    printf("initialised internal page pool [addr: 0x%08lX, size: %ld pages, "
+           "node: %d]\n", _buffer_addr, _buffer_size >> L4_PAGESHIFT,
+           static_cast<int>(_node));
+  }
 
 public:
+  bool contains(page_t page) const
+  { return (_buffer_addr <= page) && (page - _buffer_addr < _buffer_size); }
+
+  bool has_free_page(void) const { return _pages_free > 0; }
+
+  unsigned node(void) const { return _node; }
+
   page_t allocate_page(void)
   {
     // search for a free page.
@@ -76,6 +118,7 @@ public:
 
     // mark page as allocated.
     *free_page = false;
+    _pages_free--;
 
     // convert allocation into pointer.
     l4_size_t free_page_idx = free_page - _free_pages.begin();
@@ -94,6 +137,7 @@ public:
 
     // mark page as freed.
     *(_free_pages.begin() + page_idx) = true;
+    _pages_free++;
 
     // return page to the system.
     _buffer_cap->clear(page_offs_in_buffer, L4_PAGESIZE);
@@ -121,8 +165,21 @@ public:
 //   selectively mapped to the client access windows).
 //   = pool of immutable pages for every client.
 //
+// - optionally, leverage additional pools of immutable pages that are bound to
+//   memory nodes. a new immutable page is taken from the pool of the node that
+//   the client of its first sharer runs on, if possible. the memory component
+//   may relocate it later on, once most of its sharers run on another node.
+//
+// - serve the dataspaces of the clients in a bounded number of server threads
+//   (one per client, as long as there are enough), so that a slow unmerge only
+//   stalls the page faults of the clients that share its thread.
+//
 // - use L4Re::Dataspace::clear() for pages that got mapped over or are no
-//   longer needed anymore. Notice that this means it depends on the underlying
+//   longer needed anymore. the most recently freed volatile pages of every
+//   client are kept backed in a small reservoir, and a background thread
+//   clears the pages that drop out of it. unmerging a page from the
+//   reservoir thus does not fault to (and zero a page in) the system
+//   allocator. Notice that this means it depends on the underlying
 //   dataspace implementation whether this allocator returns unused (cleared)
 //   pages to the system or not.
 //
@@ -137,20 +194,90 @@ class DsL4ReAllocator : public L4ReAllocator
     l4_addr_t acc_window_start;
     l4_addr_t vol_pool_start;
     L4::Cap<L4Re::Dataspace> internal_ds_cap;
+    // offsets of freed volatile pages that are still backed, oldest first.
+    std::list<l4_addr_t> reservoir;
+    // position of every offset in the reservoir, to take pages out of it
+    // without searching.
+    std::unordered_map<l4_addr_t, std::list<l4_addr_t>::iterator>
+      reservoir_index;
+  };
+
+  enum
+  {
+    // maximum number of clients (i.e. dataspaces handed out).
+    Max_clients = 64,
   };
 
-  typedef std::list<client_info_t> client_log_t;
-  typedef std::list<Spmm::Dataspace *> ds_list_t;
+  typedef ClientTable<client_info_t, Max_clients> client_log_t;
+  typedef ClientTable<Spmm::Dataspace *, Max_clients> ds_list_t;
+  typedef std::list<Spmm::HintDevice *> hint_list_t;
+  typedef std::list<PageAllocator *> pool_list_t;
+  typedef std::vector<ServerThread *> server_list_t;
+
+  enum
+  {
+    // maximum number of threads that serve the dataspaces of the clients.
+    Max_ds_servers = 4,
+    // number of freed volatile pages per client that are kept backed.
+    Reservoir_pages = 256,
+  };
 
 private:
   PageAllocator _page_pool;
+  pool_list_t _node_pools;
+  // protects the pools of immutable pages, which are allocated from
+  // concurrently by the threads that serve the clients and by the worker.
+  std::mutex _pools_mutex;
+  // both are indexed by client and read without locking, see ClientTable.
   client_log_t _clients;
   ds_list_t _ds_list;
+  hint_list_t _hint_devices;
+  server_list_t _ds_servers;
+  // protects the reservoirs, the page lock of a page is taken first.
+  std::mutex _reservoir_mutex;
+  std::condition_variable _reservoir_full;
+
+  ServerThread *_ds_server(client_t client)
+  {
+    // clients share the threads round-robin once all have been started.
+    l4_size_t idx = client % Max_ds_servers;
+    if (idx == _ds_servers.size())
+      _ds_servers.push_back(
+        new ServerThread(L4::Kobject_typeid<L4Re::Dataspace>::Demand()));
+    return _ds_servers[idx];
+  }
+
+  PageAllocator *_find_pool(page_t page)
+  {
+    for (pool_list_t::value_type &pool : _node_pools)
+      if (pool->contains(page))
+        return pool;
+    // fallthrough.
+    // pages that are not part of a node pool belong to the default pool.
+    return &_page_pool;
+  }
+
+  PageAllocator *_select_pool(l4_addr_t hint)
+  {
+    // prefer the pool of the node that the client of the hint runs on.
+    unsigned node = get_node(hint);
+    for (pool_list_t::value_type &pool : _node_pools)
+      if (pool->node() == node && pool->has_free_page())
+        return pool;
+    // fallthrough.
+    // fall back to the default pool and then to any other pool.
+    if (_page_pool.has_free_page())
+      return &_page_pool;
+    for (pool_list_t::value_type &pool : _node_pools)
+      if (pool->has_free_page())
+        return pool;
+    return &_page_pool;
+  }
 
   page_t _retrieve_client_page(l4_addr_t hint)
   {
     // search every client.
-    for (client_log_t::value_type &client_info : _clients)
+    for (client_info_t &client_info : _clients)
     {
       // check lower bound.
       if (!(client_info.acc_window_start <= hint))
@@ -163,8 +290,10 @@ private:
         continue; // with next client.
 
       // found correct client.
+      // the page is still backed, if it is part of the reservoir.
       page_t page = client_info.vol_pool_start + mem_offset;
-      l4_touch_rw(reinterpret_cast<void const *>(page), L4_PAGESIZE);
+      if (!_take_from_reservoir(client_info, mem_offset))
+        l4_touch_rw(reinterpret_cast<void const *>(page), L4_PAGESIZE);
       return page;
     }
     // fallthrough.
@@ -176,7 +305,7 @@ private:
   void _free_client_page(page_t page)
   {
     // search every client.
-    for (client_log_t::value_type &client_info : _clients)
+    for (client_info_t &client_info : _clients)
     {
       // check lower bound.
       if (!(client_info.acc_window_start <= page))
@@ -189,7 +318,13 @@ private:
         continue; // with next client.
 
       // found correct client.
-      client_info.internal_ds_cap->clear(mem_offset, L4_PAGESIZE);
+      // keep the page backed for now, the reservoir thread clears it later.
+      std::lock_guard<std::mutex> const lock(_reservoir_mutex);
+      client_info.reservoir.push_back(mem_offset);
+      client_info.reservoir_index[mem_offset] =
+        std::prev(client_info.reservoir.end());
+      if (client_info.reservoir.size() > Reservoir_pages)
+        _reservoir_full.notify_one();
       return;
     }
     // fallthrough.
@@ -197,22 +332,109 @@ private:
     // simply do nothing.
   };
 
+  bool _take_from_reservoir(client_info_t &client_info, l4_addr_t mem_offset)
+  {
+    std::lock_guard<std::mutex> const lock(_reservoir_mutex);
+    auto it = client_info.reservoir_index.find(mem_offset);
+    if (it == client_info.reservoir_index.end())
+      return false;
+
+    client_info.reservoir.erase(it->second);
+    client_info.reservoir_index.erase(it);
+    return true;
+  }
+
+  client_info_t *_find_overfull_reservoir(void)
+  {
+    for (client_info_t &client_info : _clients)
+      if (client_info.reservoir.size() > Reservoir_pages)
+        return &client_info;
+    // fallthrough.
+    return nullptr;
+  }
+
+  // clear the oldest pages of every reservoir that grew too large.
+  void _trim_reservoirs(void)
+  {
+    std::unique_lock<std::mutex> lock(_reservoir_mutex);
+    while (true)
+    {
+      client_info_t *client_info;
+      _reservoir_full.wait(lock, [&] {
+        return (client_info = _find_overfull_reservoir()) != nullptr; });
+
+      // the page might be unmerged meanwhile, so take its lock and check
+      // whether it is still part of the reservoir afterwards.
+      l4_addr_t mem_offset = client_info->reservoir.front();
+      page_t page = client_info->acc_window_start + mem_offset;
+      lock.unlock();
+      manager->lock_page(this, page);
+      if (_take_from_reservoir(*client_info, mem_offset))
+        client_info->internal_ds_cap->clear(mem_offset, L4_PAGESIZE);
+      manager->unlock_page(this, page);
+      lock.lock();
+    }
+  }
+
+  static void *_as_reservoir_trimmer(void *arg)
+  {
+    static_cast<DsL4ReAllocator *>(arg)->_trim_reservoirs();
+    return nullptr;
+  }
+
+  Spmm::Dataspace *_find_client(page_t page)
+  {
+    // search the dataspace of every client.
+    for (Spmm::Dataspace *ds_ptr : _ds_list)
+      if (ds_ptr->contains(page))
+        return ds_ptr;
+    // fallthrough.
+    return nullptr;
+  }
+
 public:
   DsL4ReAllocator(l4_size_t pool_size) : _page_pool(pool_size)
-  {};
+  {
+    pthread_t thread;
+    if (pthread_create(&thread, nullptr, _as_reservoir_trimmer, this))
+      chksys(-L4_ENOSYS, "pthread_create failure");
+  };
 
   ~DsL4ReAllocator()
   {
-    for (ds_list_t::value_type &ds_ptr : _ds_list)
+    for (Spmm::Dataspace *ds_ptr : _ds_list)
     {
-      server.registry()->unregister_obj(ds_ptr);
+      _ds_server(ds_ptr->client())->registry()->unregister_obj(ds_ptr);
       delete ds_ptr;
     }
+    for (hint_list_t::value_type &hint_ptr : _hint_devices)
+      delete hint_ptr;
+    for (pool_list_t::value_type &pool : _node_pools)
+      delete pool;
   }
 
+  /**
+   * Add a pool of immutable pages that is bound to a memory node.
+   *
+   * @param pool_cap  Dataspace that covers the memory of the pool.
+   * @param node      The memory node the pool is bound to.
+   */
+  void add_pool(L4::Cap<L4Re::Dataspace> pool_cap, unsigned node)
+  { _node_pools.push_back(new PageAllocator(pool_cap, node)); }
+
   int op_create(L4::Factory::Rights, L4::Ipc::Cap<void> &res, l4_umword_t type,
                 L4::Ipc::Varg_list<> &&args) override
   {
+    // hand out a hint device, if requested.
+    if (type == L4VIRTIO_PROTOCOL)
+    {
+      Spmm::HintDevice *dev = Spmm::HintDevice::create(manager);
+      _hint_devices.push_back(dev);
+      res = L4::Ipc::make_cap_rw(dev->obj_cap());
+      printf("handing out hint device\n");
+      return L4_EOK;
+    }
+
     // check protocol.
     if (type != L4Re::Dataspace::Protocol)
       return -L4_ENODEV;
@@ -236,6 +458,16 @@ public:
 
     mem_align = tags[2].is_of_int() ? tags[2].value<l4_size_t>() : 0;
 
+    // parse client options.
+    Policy policy;
+    for (L4::Ipc::Varg opt : args)
+      if (policy.parse(opt) != L4_EOK)
+        return -L4_EINVAL;
+
+    // clients are never removed, so their number is bounded.
+    if (_ds_list.full())
+      return -L4_ENOMEM;
+
     // allocate backing memory.
     L4Re::Env const *env = L4Re::Env::env();
     L4::Cap<L4Re::Dataspace> mem_cap;
@@ -264,29 +496,32 @@ public:
            "ds mem map (access window)");
 
     // log client information.
-    _clients.push_back({acc_window_start, vol_pool_start, mem_cap});
+    _clients.add({acc_window_start, vol_pool_start, mem_cap, {}, {}});
 
     // prepare dataspace to hand out.
     Spmm::Dataspace *ds;
-    ds = new Spmm::Dataspace(acc_window_start, mem_size, mem_flags, manager);
-    _ds_list.push_back(ds);
+    ds = new Spmm::Dataspace(acc_window_start, mem_size, mem_flags, manager,
+                             _ds_list.size(), policy);
+    _ds_list.add(ds);
 
-    chkcap(server.registry()->register_obj(ds), "register new Spmm::Dataspace");
+    chkcap(_ds_server(ds->client())->registry()->register_obj(ds),
+           "register new Spmm::Dataspace");
     res = L4::Ipc::make_cap_rw(ds->obj_cap());
 
-    // register pages for SPMM operations.
+    // register pages for SPMM operations (unless the client opted out).
     for (l4_addr_t i = acc_window_start;
-         i < acc_window_end;
+         i < acc_window_end && policy.merge;
          i += L4_PAGESIZE)
     {
       manager->register_page(this, i);
-      manager->inc_pages_unshared(this);
+      manager->inc_pages_unshared(this, i);
     }
 
     printf("handing out dataspace [addr: 0x%08lX, size: %ld bytes]\n",
            acc_window_start, mem_size);
     printf("associated volatile page pool [addr: 0x%08lX, size: %ld bytes]\n",
            vol_pool_start, mem_size);
+    policy.print();
 
     return L4_EOK;
   };
@@ -297,14 +532,18 @@ public:
 
     if (flags.imm())
     {
-      page = _page_pool.allocate_page();
+      {
+        std::lock_guard<std::mutex> const lock(_pools_mutex);
+        page = _select_pool(hint)->allocate_page();
+      }
       manager->inc_pages_shared(this);
     }
     else //if (flags.vol())
     {
       page = _retrieve_client_page(hint);
+      _find_client(hint)->dec_pages_merged();
       manager->register_page(this, hint);
-      manager->inc_pages_unshared(this);
+      manager->inc_pages_unshared(this, hint);
     }
 
     return page;
@@ -314,17 +553,72 @@ public:
   {
     if (flags.imm())
     {
-      _page_pool.free_page(page);
+      {
+        std::lock_guard<std::mutex> const lock(_pools_mutex);
+        _find_pool(page)->free_page(page);
+      }
       manager->dec_pages_shared(this);
     }
     else //if (flags.vol())
     {
       _free_client_page(page);
+      _find_client(page)->inc_pages_merged();
       manager->unregister_page(this, page);
-      manager->dec_pages_unshared(this);
+      manager->dec_pages_unshared(this, page);
     }
   }
 
+  Policy const *get_policy(page_t page) override
+  {
+    Spmm::Dataspace *ds = _find_client(page);
+    return ds ? &ds->policy() : nullptr;
+  }
+
+  bool may_merge_page(page_t page, unsigned pages = 1) override
+  {
+    Spmm::Dataspace *ds = _find_client(page);
+    return ds && ds->may_merge_page(pages);
+  }
+
+  client_t get_client(page_t page) override
+  {
+    Spmm::Dataspace *ds = _find_client(page);
+    return ds ? ds->client() : invalid_client;
+  }
+
+  page_t get_page(L4::Cap<L4Re::Dataspace> ds, l4_addr_t offset) override
+  {
+    // the capability refers to one of our own dataspaces, if any.
+    L4::Cap<L4::Task> const task = L4Re::Env::env()->task();
+    for (Spmm::Dataspace *ds_ptr : _ds_list)
+      if (task->cap_equal(ds_ptr->obj_cap(), ds).label())
+        return ds_ptr->page_at(offset);
+    // fallthrough.
+    return 0;
+  }
+
+  unsigned get_node(page_t page) override
+  {
+    // immutable pages are bound to the node of their pool.
+    for (pool_list_t::value_type &pool : _node_pools)
+      if (pool->contains(page))
+        return pool->node();
+
+    // client pages are bound to the node of their client.
+    Spmm::Dataspace *ds = _find_client(page);
+    return ds ? ds->policy().node : static_cast<unsigned>(Policy::Any_node);
+  }
+
+  bool has_node_page(unsigned node) override
+  {
+    for (pool_list_t::value_type &pool : _node_pools)
+      if ((node == Policy::Any_node || pool->node() == node)
+          && pool->has_free_page())
+        return true;
+    // fallthrough.
+    return false;
+  }
+
 };
 
 } //Spmm
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <l4/cxx/minmax>
+#include <l4/l4virtio/l4virtio>
+#include <l4/l4virtio/server/l4virtio>
+#include <l4/re/error_helper>
+#include <l4/re/util/unique_cap>
+#include <l4/spmm/hint.h>
+#include <l4/spmm/statistics>
+#include <l4/sys/cxx/ipc_epiface>
+
+#include <cstring>
+
+#include "manager.h"
+#include "server-thread.h"
+
+using L4Re::chkcap;
+using L4Re::chksys;
+
+namespace Spmm
+{
+
+// a virtio device through which clients (i.e. guests of a VMM) report ranges of
+// their memory that are good candidates for same-page merging (see hint.h).
+//
+// - read-only ranges are prioritised in the queue, so that the worker scans
+//   them before anything else.
+// - free and zero-filled ranges are discarded right away, without being
+//   scanned at all. zero-filled pages are only discarded if they are still
+//   zero-filled at that point, which the kernel checks atomically.
+//
+// the guest memory that holds the virtqueue is usually provided by the SPMM
+// itself. every hint device is therefore served by a dedicated server thread.
+class HintDevice : public Component,
+                   public L4virtio::Svr::Device,
+                   public L4::Epiface_t<HintDevice, L4virtio::Device>
+{
+  struct Buffer : L4virtio::Svr::Data_buffer
+  {
+    Buffer() = default;
+    Buffer(L4virtio::Svr::Driver_mem_region const *r,
+           L4virtio::Svr::Virtqueue::Desc const &d,
+           L4virtio::Svr::Request_processor const *)
+    {
+      pos = static_cast<char *>(r->local(d.addr));
+      left = d.len;
+    }
+  };
+
+  struct Host_irq : public L4::Irqep_t<Host_irq>
+  {
+    explicit Host_irq(HintDevice *d) : d(d) {}
+    HintDevice *d;
+    void handle_irq() { d->kick(); }
+  };
+
+  enum
+  {
+    Max_desc = 0x100,
+    Max_mem_regions = 8,
+  };
+private:
+  Host_irq _host_irq;
+  L4virtio::Svr::Dev_config _dev_config;
+  L4virtio::Svr::Virtqueue _q;
+  L4Re::Util::Unique_cap<L4::Irq> _kick_guest_irq;
+  L4Re::Util::Object_registry *_registry;
+
+  static ServerThread *_server_thread(void)
+  {
+    static ServerThread *st =
+      new ServerThread(L4::Kobject_typeid<L4virtio::Device>::Demand());
+    return st;
+  }
+
+  page_t _translate(L4virtio::Svr::Driver_mem_region const *r,
+                    l4_uint64_t addr)
+  {
+    l4_addr_t offset = r->ds_offset() + (addr - r->drv_base());
+    return manager->get_page(this, r->ds(), offset);
+  }
+
+  void _process_hint(l4spmm_hint_t const &hint)
+  {
+    l4_uint64_t const offset_mask = L4_PAGESIZE - 1;
+    l4_uint64_t end = hint.addr + hint.size;
+    if (end < hint.addr)
+      return;
+
+    // read-only hints cover every page they touch, whereas free and zero hints
+    // only cover pages that they span completely.
+    l4_uint64_t first, last;
+    if (hint.type == L4SPMM_HINT_READ_ONLY)
+    {
+      first = hint.addr & ~offset_mask;
+      last = (end + offset_mask) & ~offset_mask;
+    }
+    else if (hint.type == L4SPMM_HINT_FREE || hint.type == L4SPMM_HINT_ZERO)
+    {
+      first = (hint.addr + offset_mask) & ~offset_mask;
+      last = end & ~offset_mask;
+    }
+    else
+      return;
+
+    // the range is under control of the guest. it is split up by the memory
+    // regions that the guest shared with the device and cut off where it
+    // leaves them, so its size does not matter.
+    while (first < last)
+    {
+      // find the dataspace that the guest address belongs to.
+      L4virtio::Svr::Driver_mem_region const *r;
+      r = mem_info()->find(first, L4_PAGESIZE);
+      if (!r)
+        return;
+
+      l4_uint64_t region_end = l4_trunc_page(r->drv_base() + r->size());
+      l4_uint64_t end = cxx::min(last, region_end);
+      if (end <= first)
+        return;
+
+      for (l4_uint64_t addr = first; addr < end; addr += L4_PAGESIZE)
+      {
+        page_t page = _translate(r, addr);
+        if (!page)
+          continue; // with next page.
+
+        manager->lock_page(this, page);
+        if (hint.type == L4SPMM_HINT_READ_ONLY)
+        {
+          manager->set_content_class(this, page,
+                                     Spmm::Stats::Class_read_only);
+          manager->prioritize_page(this, page);
+        }
+        else
+          manager->discard_page(this, page, hint.type == L4SPMM_HINT_ZERO);
+        manager->unlock_page(this, page);
+      }
+
+      first = end;
+    }
+  }
+
+public:
+  HintDevice(Manager *manager, L4Re::Util::Object_registry *registry)
+    : Component(manager),
+      L4virtio::Svr::Device(&_dev_config),
+      _host_irq(this),
+      _dev_config(0x44, L4VIRTIO_ID_SPMM_HINT, 0, 1),
+      _registry(registry)
+  {
+    reset_queue_config(0, Max_desc);
+    init_mem_info(Max_mem_regions);
+    chkcap(_registry->register_irq_obj(&_host_irq), "register hint irq");
+  }
+
+  ~HintDevice()
+  {
+    _registry->unregister_obj(&_host_irq);
+    _registry->unregister_obj(this);
+  }
+
+  /**
+   * Create a new hint device and register it at the hint server thread.
+   *
+   * @param manager  The manager of the new device.
+   *
+   * @returns        The new device.
+   */
+  static HintDevice *create(Manager *manager)
+  {
+    L4Re::Util::Object_registry *registry = _server_thread()->registry();
+    HintDevice *dev = new HintDevice(manager, registry);
+    chkcap(registry->register_obj(dev), "register new Spmm::HintDevice");
+    return dev;
+  }
+
+  void register_single_driver_irq() override
+  {
+    _kick_guest_irq = L4Re::Util::Unique_cap<L4::Irq>(
+        chkcap(server_iface()->rcv_cap<L4::Irq>(0)));
+    chksys(server_iface()->realloc_rcv_cap(0));
+  }
+
+  void trigger_driver_config_irq() const override
+  { _kick_guest_irq->trigger(); }
+
+  L4::Cap<L4::Irq> device_notify_irq() const override
+  { return L4::cap_cast<L4::Irq>(_host_irq.obj_cap()); }
+
+  void reset() override
+  { _q.disable(); }
+
+  int reconfig_queue(unsigned index) override
+  {
+    if (index != 0)
+      return -L4_ERANGE;
+
+    if (setup_queue(&_q, index, Max_desc))
+      return 0;
+
+    return -L4_EINVAL;
+  }
+
+  bool check_queues() override
+  {
+    if (!_q.ready())
+    {
+      reset();
+      printf("failed to start hint queue\n");
+      return false;
+    }
+
+    return true;
+  }
+
+  void notify_queue(L4virtio::Svr::Virtqueue *queue)
+  {
+    if (queue->no_notify_guest())
+      return;
+
+    _kick_guest_irq->trigger();
+  }
+
+  void kick(void)
+  {
+    if (!_q.ready())
+      return;
+
+    L4virtio::Svr::Request_processor p;
+    L4virtio::Svr::Virtqueue::Head_desc h;
+    Buffer b;
+
+    try
+    {
+      while (auto r = _q.next_avail())
+      {
+        h = p.start(mem_info(), r, &b);
+        for (;;)
+        {
+          // a buffer holds an array of hints.
+          while (b.left >= sizeof(l4spmm_hint_t))
+          {
+            l4spmm_hint_t hint;
+            memcpy(&hint, b.pos, sizeof(hint));
+            b.skip(sizeof(hint));
+            _process_hint(hint);
+          }
+          if (!p.next(mem_info(), &b))
+            break;
+        }
+        _q.finish(h, this);
+      }
+    }
+    catch (L4virtio::Svr::Bad_descriptor const &e)
+    {
+      printf("bad descriptor in hint queue\n");
+      device_error();
+    }
+  }
+
+  L4::Ipc_svr::Server_iface *server_iface() const override
+  { return L4::Epiface::server_iface(); }
+};
+
+} //Spmm
@@ -15,7 +15,9 @@ namespace Spmm
  *
  * Every page can only be locked by one thread at every point in time.
  * Further, a single thread might accquire and hold locks to multiple pages
- * simultaneously.
+ * simultaneously. A thread that already holds a page lock must only try to
+ * lock further pages (see try_lock_page()) and back off on contention, so that
+ * threads never wait for each other in a cycle.
  */
 class Lock : public Component
 {
@@ -32,6 +34,16 @@ public:
    */
   virtual void lock_page(page_t page) = 0;
 
+  /**
+   * Try to claim exclusive access to a page without blocking.
+   *
+   * @param page  The page to which exclusive access should be obtained.
+   *
+   * @returns     True if exclusive access has been obtained, false in case of
+   *              contention.
+   */
+  virtual bool try_lock_page(page_t page) = 0;
+
   /**
    * Release exclusive access to a page.
    *
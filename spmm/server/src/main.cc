@@ -3,6 +3,8 @@
 #include <l4/re/util/object_registry>
 #include <l4/util/util.h>
 
+#include <cstdio>
+
 #include "simple-l4re-allocator.h"
 #include "ds-l4re-allocator.h"
 #include "simple-lock.h"
@@ -16,6 +18,9 @@ using L4Re::chkcap;
 
 L4Re::Util::Registry_server<L4Re::Util::Br_manager_hooks> server;
 
+// maximum number of memory nodes with a dedicated pool of immutable pages.
+enum { Max_nodes = 8 };
+
 int main(void)
 {
   //Spmm::SimpleL4ReAllocator *allocator  = new Spmm::SimpleL4ReAllocator();
@@ -26,6 +31,18 @@ int main(void)
   Spmm::SimpleStatistics    *statistics = new Spmm::SimpleStatistics();
   Spmm::SimpleWorker        *worker     = new Spmm::SimpleWorker(65536, 10000);
 
+  // bind additional pools of immutable pages to memory nodes, if provided.
+  // the pool of node n is supplied as dataspace capability "spmm_pool<n>".
+  for (unsigned node = 0; node < Max_nodes; node++)
+  {
+    char name[16];
+    snprintf(name, sizeof(name), "spmm_pool%u", node);
+    L4::Cap<L4Re::Dataspace> pool_cap;
+    pool_cap = L4Re::Env::env()->get_cap<L4Re::Dataspace>(name);
+    if (pool_cap.is_valid())
+      allocator->add_pool(pool_cap, node);
+  }
+
   Spmm::SimpleManager *manager;
   manager = new Spmm::SimpleManager(allocator, lock, memory, queue, statistics,
                                     worker);
@@ -34,7 +51,18 @@ int main(void)
   l4re_allocator = static_cast<Spmm::L4ReAllocator *>(allocator);
   chkcap(server.registry()->register_obj(l4re_allocator, "spmm_allocator"),
          "register allocator");
+
+  // provide the statistics query interface, if requested.
+  bool query_statistics;
+  query_statistics = L4Re::Env::env()->get_cap<void>("spmm_statistics")
+                                     .is_valid();
+  if (query_statistics)
+    chkcap(server.registry()->register_obj(statistics, "spmm_statistics"),
+           "register statistics");
+
   server.loop();
+  if (query_statistics)
+    server.registry()->unregister_obj(statistics);
   server.registry()->unregister_obj(l4re_allocator);
 
   delete manager;
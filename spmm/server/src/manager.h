@@ -1,5 +1,7 @@
 #pragma once
 
+#include <l4/re/dataspace>
+#include <l4/spmm/trace.h>
 #include <l4/sys/types.h>
 
 #include "flags-fwd.h"
@@ -13,6 +15,18 @@ namespace Spmm
  */
 typedef l4_addr_t page_t;
 
+/**
+ * Intra-package uniform type to refer to a client of the SPMM.
+ * Clients are numbered in the order in which they requested their memory.
+ */
+typedef unsigned client_t;
+static constexpr client_t invalid_client = ~0U;
+
+/**
+ * Per-client policy for same-page merging operations, see policy.h.
+ */
+struct Policy;
+
 /**
  * Abstract "client" class of the mediator pattern.
  *
@@ -39,9 +53,12 @@ public:
                            MemoryFlags flags) const = 0;
   virtual long unmerge_page(Component *caller, page_t page) const = 0;
   virtual bool is_merged_page(Component *caller, page_t page) const = 0;
+  virtual long discard_page(Component *caller, page_t page,
+                            bool zero_only = false) const = 0;
 
   // lock:
   virtual void lock_page(Component *caller, page_t page) const = 0;
+  virtual bool try_lock_page(Component *caller, page_t page) const = 0;
   virtual void unlock_page(Component *caller, page_t page) const = 0;
 
   // allocator:
@@ -49,25 +66,48 @@ public:
                                l4_addr_t hint = 0) const = 0;
   virtual void free_page(Component *caller, AllocatorFlags flags,
                          page_t page) const = 0;
+  virtual Policy const *get_policy(Component *caller, page_t page) const = 0;
+  virtual bool may_merge_page(Component *caller, page_t page,
+                              unsigned pages = 1) const = 0;
+  virtual unsigned get_node(Component *caller, page_t page) const = 0;
+  virtual bool has_node_page(Component *caller, unsigned node) const = 0;
+  virtual client_t get_client(Component *caller, page_t page) const = 0;
+  virtual page_t get_page(Component *caller, L4::Cap<L4Re::Dataspace> ds,
+                          l4_addr_t offset) const = 0;
 
   // queue:
   virtual void register_page(Component *caller, page_t page) const = 0;
   virtual void unregister_page(Component *caller, page_t page) const = 0;
   virtual page_t get_next_page(Component *caller) const = 0;
+  virtual void prioritize_page(Component *caller, page_t page) const = 0;
 
   // worker:
   virtual void run(Component *caller) const = 0;
   virtual bool page_unmerge_notification(Component *caller,
                                          page_t page) const = 0;
+  virtual void page_discard_notification(Component *caller,
+                                         page_t page) const = 0;
+  virtual bool merge_loaded_page(Component *caller, page_t page,
+                                 l4_uint64_t source,
+                                 l4_addr_t offset) const = 0;
 
   // statistics:
   virtual void inc_pages_shared(Component *caller) const = 0;
   virtual void dec_pages_shared(Component *caller) const = 0;
-  virtual void inc_pages_sharing(Component *caller) const = 0;
-  virtual void dec_pages_sharing(Component *caller) const = 0;
-  virtual void inc_pages_unshared(Component *caller) const = 0;
-  virtual void dec_pages_unshared(Component *caller) const = 0;
+  virtual void inc_pages_sharing(Component *caller, page_t page,
+                                 page_t imm_page) const = 0;
+  virtual void dec_pages_sharing(Component *caller, page_t page,
+                                 page_t imm_page) const = 0;
+  virtual void inc_pages_unshared(Component *caller, page_t page) const = 0;
+  virtual void dec_pages_unshared(Component *caller, page_t page) const = 0;
   virtual void inc_full_scans(Component *caller) const = 0;
+  virtual void set_content_class(Component *caller, page_t page,
+                                 unsigned cls) const = 0;
+  virtual void add_fault(Component *caller, client_t client,
+                         l4_uint64_t latency_us) const = 0;
+  virtual void trace_event(Component *caller, l4spmm_trace_event_type type,
+                           l4_uint64_t arg0 = 0,
+                           l4_uint64_t arg1 = 0) const = 0;
 };
 
 class Component
@@ -78,6 +78,29 @@ public:
    * @returns           True if the page is currently merged.
    */
   virtual bool is_merged_page(page_t page) = 0;
+
+  /**
+   * Discard the content of a memory page.
+   *
+   * @param page        The page that should be discarded.
+   * @param zero_only   Only discard the page if it is zero-filled, so that no
+   *                    content is lost. Writes to the page are taken into
+   *                    account until it has been discarded.
+   *
+   * @retval L4_EOK     Success.
+   * @retval -L4_EINVAL Invalid arguments such as passing in an invalid page.
+   * @retval -L4_EEXIST The page is currently merged (only with zero_only).
+   * @retval -L4_EPERM  The policy of the client does not permit merging the
+   *                    page.
+   * @retval -L4_EFAULT The page is not zero-filled (only with zero_only).
+   *
+   * On success, the page is merged with a shared zero-filled page and mapped
+   * read-only to its original address. Its previous content is lost. A merged
+   * page stops sharing its immutable page without being unmerged. The page
+   * is unmerged on the next write access like any other merged page. On
+   * failure, page and page mapping will not have been modified.
+   */
+  virtual long discard_page(page_t page, bool zero_only = false) = 0;
 };
 
 struct MemoryFlags : L4::Types::Flags_ops_t<MemoryFlags>
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <l4/cxx/string>
+#include <l4/sys/cxx/ipc_varg>
+#include <l4/sys/err.h>
+
+#include <cstdio>
+
+namespace Spmm
+{
+
+/**
+ * Per-client policy for same-page merging operations.
+ *
+ * Every client of the SPMM can tune how its memory is treated by passing
+ * additional options of the form "key=value" when it requests a dataspace,
+ * for example from ned:
+ *
+ *   spmm_channel:create(L4.Proto.Dataspace, size, flags, align,
+ *                       "priority=0", "max-share=50", "min-age=3");
+ *
+ * Supported options:
+ *
+ * merge=<0|1>        - whether pages of this client are merged at all.
+ * priority=<0..3>    - scan priority, higher priorities are scanned more often.
+ * max-share=<0..100> - maximum percentage of pages that may be merged.
+ * min-age=<n>        - number of consecutive scans a page has to remain
+ *                      unchanged before it is considered for merging.
+ * node=<n>           - memory node (e.g. CPU cluster) the client runs on.
+ *                      Merged pages are preferably placed in the immutable page
+ *                      pool of the node that most of their sharers run on.
+ * fault-around=<0..16> - number of pages that a page fault maps at once: the
+ *                      faulting page and its resident, unmerged neighbours
+ *                      within a naturally aligned block of this size.
+ */
+struct Policy
+{
+  enum
+  {
+    /// Highest scan priority a client can request.
+    Max_priority = 3,
+    /// Scan priority of clients that did not request one.
+    Default_priority = 1,
+    /// Memory node of clients that did not request one.
+    Any_node = ~0U,
+    /// Largest fault-around block a client can request, in pages.
+    Max_fault_around = 16,
+  };
+
+  bool     merge     = true;
+  unsigned priority  = Default_priority;
+  unsigned max_share = 100;
+  unsigned min_age   = 0;
+  unsigned node      = Any_node;
+  unsigned fault_around = 0;
+
+  /**
+   * Parse a single client option.
+   *
+   * @param opt         The option, see above for the supported options.
+   *
+   * @retval L4_EOK     Success.
+   * @retval -L4_EINVAL Unknown option or invalid value.
+   */
+  long parse(L4::Ipc::Varg const &opt)
+  {
+    if (!opt.is_of<char const *>())
+      return -L4_EINVAL;
+
+    cxx::String const o(opt.value<char const *>(), opt.length() - 1);
+    unsigned value;
+
+    if (cxx::String::Index v = o.starts_with("merge="))
+    {
+      if (!_parse_value(o.substr(v), &value) || value > 1)
+        return -L4_EINVAL;
+      merge = value;
+    }
+    else if (cxx::String::Index v = o.starts_with("priority="))
+    {
+      if (!_parse_value(o.substr(v), &value) || value > Max_priority)
+        return -L4_EINVAL;
+      priority = value;
+    }
+    else if (cxx::String::Index v = o.starts_with("max-share="))
+    {
+      if (!_parse_value(o.substr(v), &value) || value > 100)
+        return -L4_EINVAL;
+      max_share = value;
+    }
+    else if (cxx::String::Index v = o.starts_with("min-age="))
+    {
+      if (!_parse_value(o.substr(v), &value))
+        return -L4_EINVAL;
+      min_age = value;
+    }
+    else if (cxx::String::Index v = o.starts_with("node="))
+    {
+      if (!_parse_value(o.substr(v), &value) || value == Any_node)
+        return -L4_EINVAL;
+      node = value;
+    }
+    else if (cxx::String::Index v = o.starts_with("fault-around="))
+    {
+      if (!_parse_value(o.substr(v), &value) || value > Max_fault_around)
+        return -L4_EINVAL;
+      fault_around = value;
+    }
+    else
+      return -L4_EINVAL;
+
+    return L4_EOK;
+  }
+
+  void print(void) const
+  {
+    printf("client policy [merge: %u, priority: %u, max-share: %u%%, "
+           "min-age: %u, node: %d, fault-around: %u]\n", merge, priority,
+           max_share, min_age, static_cast<int>(node), fault_around);
+  }
+
+private:
+  static bool _parse_value(cxx::String const &s, unsigned *value)
+  { return !s.empty() && s.from_dec(value) == s.len(); }
+};
+
+} //Spmm
@@ -40,6 +40,19 @@ public:
    * @returns     The page.
    */
   virtual page_t get_next_page(void) = 0;
+
+  /**
+   * Hand out a page ahead of every other page of this queue.
+   *
+   * @param page  The page which should be prioritised.
+   *
+   * This allows other components to direct the attention of a worker to pages
+   * which are known to be good candidates for merging, e.g. because a client
+   * reported them to be read-only. Pages that get unregistered before they are
+   * handed out are dropped. Other pages are handed out even if they are not
+   * registered (e.g. merged pages), workers have to skip them.
+   */
+  virtual void prioritize_page(page_t page) = 0;
 };
 
 } //Spmm
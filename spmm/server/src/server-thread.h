@@ -0,0 +1,68 @@
+#pragma once
+
+#include <l4/re/env>
+#include <l4/re/error_helper>
+#include <l4/re/util/br_manager>
+#include <l4/re/util/object_registry>
+#include <pthread-l4.h>
+
+#include <mutex>
+
+using L4Re::chksys;
+
+namespace Spmm
+{
+
+// a helper class that runs an additional server loop in its own thread.
+// objects that access memory which is provided by the SPMM itself (and thus
+// served by the main server loop) must not be served by the main server loop,
+// as their page faults would never be resolved.
+class ServerThread
+{
+  typedef L4Re::Util::Registry_server<L4Re::Util::Br_manager_hooks> server_t;
+private:
+  server_t *_server;
+  pthread_t _thread;
+  // held until the server loop is set up completely.
+  std::mutex _setup;
+
+  static void *_loop(void *arg)
+  {
+    ServerThread *self = static_cast<ServerThread *>(arg);
+    self->_setup.lock();
+    self->_setup.unlock();
+    self->_server->loop();
+    return nullptr;
+  }
+
+public:
+  /**
+   * Start a new server loop.
+   *
+   * @param demand  Receive buffer demand of the objects that are going to be
+   *                served by this loop. The buffers have to be known before the
+   *                loop starts waiting for messages.
+   */
+  ServerThread(L4::Type_info::Demand const &demand)
+  {
+    std::lock_guard<std::mutex> setup(_setup);
+
+    pthread_attr_t thread_attributes;
+    pthread_attr_init(&thread_attributes);
+    if (pthread_create(&_thread, &thread_attributes, _loop, this))
+      chksys(-L4_ENOSYS, "pthread_create failure");
+    pthread_attr_destroy(&thread_attributes);
+
+    _server = new server_t(Pthread::L4::cap(_thread),
+                           L4Re::Env::env()->factory());
+    chksys(_server->alloc_buffer_demand(demand),
+           "server thread buffer demand");
+  }
+
+  ServerThread(ServerThread const &st) = delete;
+
+  L4Re::Util::Object_registry *registry(void)
+  { return _server->registry(); }
+};
+
+} //Spmm
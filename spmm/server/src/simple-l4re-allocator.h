@@ -6,9 +6,13 @@
 
 #include <cstdio>
 #include <list>
-#include <sys/mman.h>
+#include <map>
+#include <mutex>
 
 #include "allocator.h"
+#include "arena-allocator.h"
+#include "client-table.h"
+#include "hint-device.h"
 
 using L4Re::chkcap;
 using L4Re::chksys;
@@ -18,37 +22,68 @@ extern L4Re::Util::Registry_server<L4Re::Util::Br_manager_hooks> server;
 namespace Spmm
 {
 
-// simple allocator component that allocates memory through mmap and does not
-// return memory on free.
+// simple allocator component that allocates memory from the arenas of an
+// ArenaAllocator.
+//
+// volatile pages are mapped over the pages of their client, so a freed
+// volatile page is known by the address of the client page only. the page
+// that backs it is either part of the memory of the client or a page that was
+// allocated on unmerge, which is remembered until the page is freed again.
 class SimpleL4ReAllocator : public L4ReAllocator
 {
-  typedef std::list<Spmm::Dataspace *> ds_list_t;
+  enum
+  {
+    // maximum number of clients (i.e. dataspaces handed out).
+    Max_clients = 64,
+  };
+
+  typedef ClientTable<Spmm::Dataspace *, Max_clients> ds_list_t;
+  typedef std::list<Spmm::HintDevice *> hint_list_t;
+  typedef std::map<page_t, page_t> page_map_t;
 private:
+  // indexed by client and read without locking, see ClientTable.
   ds_list_t _ds_list;
+  hint_list_t _hint_devices;
+  ArenaAllocator _arena;
+  // client page -> page that was allocated for it on unmerge.
+  page_map_t _vol_pages;
+  std::mutex _vol_pages_mutex;
 
-  l4_addr_t _allocate(l4_size_t size)
+  Spmm::Dataspace *_find_client(page_t page)
   {
-    // allocate memory through mmap.
-    int const prot = PROT_READ | PROT_WRITE | PROT_EXEC;
-    int const flags = MAP_ANONYMOUS;
-    void *ptr = mmap(0, size, prot, flags, -1, 0);
-    l4_addr_t res = reinterpret_cast<l4_addr_t>(ptr);
-    return res;
+    // search the dataspace of every client.
+    for (Spmm::Dataspace *ds_ptr : _ds_list)
+      if (ds_ptr->contains(page))
+        return ds_ptr;
+    // fallthrough.
+    return nullptr;
   }
 
 public:
   ~SimpleL4ReAllocator()
   {
-    for (ds_list_t::value_type &ds_ptr : _ds_list)
+    for (Spmm::Dataspace *ds_ptr : _ds_list)
     {
       server.registry()->unregister_obj(ds_ptr);
       delete ds_ptr;
     }
+    for (hint_list_t::value_type &hint_ptr : _hint_devices)
+      delete hint_ptr;
   }
 
   int op_create(L4::Factory::Rights, L4::Ipc::Cap<void> &res, l4_umword_t type,
                 L4::Ipc::Varg_list<> &&args) override
   {
+    // hand out a hint device, if requested.
+    if (type == L4VIRTIO_PROTOCOL)
+    {
+      Spmm::HintDevice *dev = Spmm::HintDevice::create(manager);
+      _hint_devices.push_back(dev);
+      res = L4::Ipc::make_cap_rw(dev->obj_cap());
+      printf("handing out hint device\n");
+      return L4_EOK;
+    }
+
     // check protocol.
     if (type != L4Re::Dataspace::Protocol)
       return -L4_ENODEV;
@@ -71,29 +106,43 @@ public:
      : L4Re::Dataspace::F::Ro;
 
     // mem_align is ignored in this allocator.
-    // defaults to page alignment (due to mmap).
+    // defaults to page alignment (or the alignment of an arena).
+
+    // parse client options.
+    Policy policy;
+    for (L4::Ipc::Varg opt : args)
+      if (policy.parse(opt) != L4_EOK)
+        return -L4_EINVAL;
+
+    // clients are never removed, so their number is bounded.
+    if (_ds_list.full())
+      return -L4_ENOMEM;
 
     // allocate backing memory.
-    l4_addr_t mem_addr = _allocate(mem_size);
+    l4_addr_t mem_addr = _arena.allocate(mem_size);
     memset(reinterpret_cast<void *>(mem_addr), 0x0, mem_size);
 
     // prepare dataspace to hand out.
     Spmm::Dataspace *ds;
-    ds = new Spmm::Dataspace(mem_addr, mem_size, mem_flags, this->manager);
-    _ds_list.push_back(ds);
+    ds = new Spmm::Dataspace(mem_addr, mem_size, mem_flags, this->manager,
+                             _ds_list.size(), policy);
+    _ds_list.add(ds);
 
     chkcap(server.registry()->register_obj(ds), "register new Spmm::Dataspace");
     res = L4::Ipc::make_cap_rw(ds->obj_cap());
 
-    // register pages for SPMM operations.
-    for (l4_addr_t i = mem_addr; i < mem_addr + mem_size; i += L4_PAGESIZE)
+    // register pages for SPMM operations (unless the client opted out).
+    for (l4_addr_t i = mem_addr;
+         i < mem_addr + mem_size && policy.merge;
+         i += L4_PAGESIZE)
     {
       manager->register_page(this, i);
-      manager->inc_pages_unshared(this);
+      manager->inc_pages_unshared(this, i);
     }
 
     printf("handing out dataspace [addr: 0x%08lX, size: %ld bytes]\n",
             mem_addr, mem_size);
+    policy.print();
 
     return L4_EOK;
   }
@@ -102,31 +151,94 @@ public:
                        [[maybe_unused]] l4_addr_t hint) override
   {
     // allocate page.
-    page_t page = _allocate(L4_PAGESIZE);
+    page_t page = _arena.allocate(L4_PAGESIZE);
 
     // update statistics.
     if (flags.imm())
       manager->inc_pages_shared(this);
     else //if (flags.vol())
     {
+      {
+        std::lock_guard<std::mutex> const lock(_vol_pages_mutex);
+        _vol_pages[hint] = page;
+      }
+      _find_client(hint)->dec_pages_merged();
       manager->register_page(this, hint);
-      manager->inc_pages_unshared(this);
+      manager->inc_pages_unshared(this, hint);
     }
     return page;
   }
 
   void free_page(AllocatorFlags flags, page_t page) override
   {
-    // simply do nothing.
     // update statistics.
     if (flags.imm())
+    {
+      _arena.free(page);
       manager->dec_pages_shared(this);
+    }
     else //if (flags.vol())
     {
+      // the page has been mapped over, release the memory behind it.
+      page_t vol_page = 0;
+      {
+        std::lock_guard<std::mutex> const lock(_vol_pages_mutex);
+        page_map_t::iterator it = _vol_pages.find(page);
+        if (it != _vol_pages.end())
+        {
+          vol_page = it->second;
+          _vol_pages.erase(it);
+        }
+      }
+      if (vol_page)
+        _arena.free(vol_page);
+      else
+        _arena.clear(page, L4_PAGESIZE);
+
+      _find_client(page)->inc_pages_merged();
       manager->unregister_page(this, page);
-      manager->dec_pages_unshared(this);
+      manager->dec_pages_unshared(this, page);
     }
   }
+
+  Policy const *get_policy(page_t page) override
+  {
+    Spmm::Dataspace *ds = _find_client(page);
+    return ds ? &ds->policy() : nullptr;
+  }
+
+  bool may_merge_page(page_t page, unsigned pages = 1) override
+  {
+    Spmm::Dataspace *ds = _find_client(page);
+    return ds && ds->may_merge_page(pages);
+  }
+
+  client_t get_client(page_t page) override
+  {
+    Spmm::Dataspace *ds = _find_client(page);
+    return ds ? ds->client() : invalid_client;
+  }
+
+  page_t get_page(L4::Cap<L4Re::Dataspace> ds, l4_addr_t offset) override
+  {
+    // the capability refers to one of our own dataspaces, if any.
+    L4::Cap<L4::Task> const task = L4Re::Env::env()->task();
+    for (Spmm::Dataspace *ds_ptr : _ds_list)
+      if (task->cap_equal(ds_ptr->obj_cap(), ds).label())
+        return ds_ptr->page_at(offset);
+    // fallthrough.
+    return 0;
+  }
+
+  unsigned get_node(page_t page) override
+  {
+    // pages from the arenas are not bound to any node, only clients can be.
+    Spmm::Dataspace *ds = _find_client(page);
+    return ds ? ds->policy().node : static_cast<unsigned>(Policy::Any_node);
+  }
+
+  bool has_node_page([[maybe_unused]] unsigned node) override
+  { return false; }
 };
 
 } //Spmm
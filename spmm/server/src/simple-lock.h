@@ -7,18 +7,27 @@
 namespace Spmm
 {
 
-// simply synchronise hard on every operation by using a shared mutex.
-// this will serialise every merge, scan und unmerge operation.
+// synchronise on a fixed number of mutexes, each of which covers every
+// Num_stripes-th page. operations on pages of different stripes (e.g. faults
+// of different clients) proceed in parallel.
 class SimpleLock : public Lock
 {
+  enum
+  {
+    Num_stripes = 128,
+  };
 private:
-  // needs to be recursive so that the same thread can accquire the lock
-  // multiple times.
-  //std::recursive_mutex _m;
-  std::mutex _m;
+  // needs to be recursive so that the same thread can accquire several pages
+  // of the same stripe.
+  std::recursive_mutex _stripes[Num_stripes];
+
+  std::recursive_mutex &_stripe(page_t page)
+  { return _stripes[(page >> L4_PAGESHIFT) % Num_stripes]; }
+
 public:
-  void lock_page([[maybe_unused]] page_t page) override { _m.lock(); }
-  void unlock_page([[maybe_unused]] page_t page) override { _m.unlock(); }
+  void lock_page(page_t page) override { _stripe(page).lock(); }
+  bool try_lock_page(page_t page) override { return _stripe(page).try_lock(); }
+  void unlock_page(page_t page) override { _stripe(page).unlock(); }
 };
 
 } //Spmm
@@ -91,10 +91,18 @@ public:
                       page_t page) const override
   { return _memory->is_merged_page(page); }
 
+  long discard_page([[maybe_unused]] Component *caller, page_t page,
+                    bool zero_only = false) const override
+  { return _memory->discard_page(page, zero_only); }
+
   // lock:
   void lock_page([[maybe_unused]] Component *caller, page_t page) const override
   { _lock->lock_page(page); }
 
+  bool try_lock_page([[maybe_unused]] Component *caller,
+                     page_t page) const override
+  { return _lock->try_lock_page(page); }
+
   void unlock_page([[maybe_unused]] Component *caller,
                    page_t page) const override
   { _lock->unlock_page(page); }
@@ -108,6 +116,31 @@ public:
                  page_t page) const override
   { _allocator->free_page(flags, page); }
 
+  Policy const *get_policy([[maybe_unused]] Component *caller,
+                           page_t page) const override
+  { return _allocator->get_policy(page); }
+
+  bool may_merge_page([[maybe_unused]] Component *caller, page_t page,
+                      unsigned pages = 1) const override
+  { return _allocator->may_merge_page(page, pages); }
+
+  unsigned get_node([[maybe_unused]] Component *caller,
+                    page_t page) const override
+  { return _allocator->get_node(page); }
+
+  bool has_node_page([[maybe_unused]] Component *caller,
+                     unsigned node) const override
+  { return _allocator->has_node_page(node); }
+
+  client_t get_client([[maybe_unused]] Component *caller,
+                      page_t page) const override
+  { return _allocator->get_client(page); }
+
+  page_t get_page([[maybe_unused]] Component *caller,
+                  L4::Cap<L4Re::Dataspace> ds,
+                  l4_addr_t offset) const override
+  { return _allocator->get_page(ds, offset); }
+
   // queue:
   void register_page([[maybe_unused]] Component *caller,
                      page_t page) const override
@@ -120,6 +153,10 @@ public:
   page_t get_next_page([[maybe_unused]] Component *caller) const override
   { return _queue->get_next_page(); }
 
+  void prioritize_page([[maybe_unused]] Component *caller,
+                       page_t page) const override
+  { _queue->prioritize_page(page); }
+
   // worker:
   void run([[maybe_unused]] Component *caller) const override
   { _worker->run(); }
@@ -128,6 +165,14 @@ public:
                                  page_t page) const override
   { return _worker->page_unmerge_notification(page); }
 
+  void page_discard_notification([[maybe_unused]] Component *caller,
+                                 page_t page) const override
+  { _worker->page_discard_notification(page); }
+
+  bool merge_loaded_page([[maybe_unused]] Component *caller, page_t page,
+                         l4_uint64_t source, l4_addr_t offset) const override
+  { return _worker->merge_loaded_page(page, source, offset); }
+
   // statistics:
   void inc_pages_shared([[maybe_unused]] Component *caller) const override
   { _statistics->inc_pages_shared(); }
@@ -135,20 +180,37 @@ public:
   void dec_pages_shared([[maybe_unused]] Component *caller) const override
   { _statistics->dec_pages_shared(); }
 
-  void inc_pages_sharing([[maybe_unused]] Component *caller) const override
-  { _statistics->inc_pages_sharing(); }
+  void inc_pages_sharing([[maybe_unused]] Component *caller, page_t page,
+                         page_t imm_page) const override
+  { _statistics->inc_pages_sharing(page, imm_page); }
 
-  void dec_pages_sharing([[maybe_unused]] Component *caller) const override
-  { _statistics->dec_pages_sharing(); }
+  void dec_pages_sharing([[maybe_unused]] Component *caller, page_t page,
+                         page_t imm_page) const override
+  { _statistics->dec_pages_sharing(page, imm_page); }
 
-  void inc_pages_unshared([[maybe_unused]] Component *caller) const override
-  { _statistics->inc_pages_unshared(); }
+  void inc_pages_unshared([[maybe_unused]] Component *caller,
+                          page_t page) const override
+  { _statistics->inc_pages_unshared(page); }
 
-  void dec_pages_unshared([[maybe_unused]] Component *caller) const override
-  { _statistics->dec_pages_unshared(); }
+  void dec_pages_unshared([[maybe_unused]] Component *caller,
+                          page_t page) const override
+  { _statistics->dec_pages_unshared(page); }
 
   void inc_full_scans([[maybe_unused]] Component *caller) const override
   { _statistics->inc_full_scans(); }
+
+  void set_content_class([[maybe_unused]] Component *caller, page_t page,
+                         unsigned cls) const override
+  { _statistics->set_content_class(page, cls); }
+
+  void add_fault([[maybe_unused]] Component *caller, client_t client,
+                 l4_uint64_t latency_us) const override
+  { _statistics->add_fault(client, latency_us); }
+
+  void trace_event([[maybe_unused]] Component *caller,
+                   l4spmm_trace_event_type type, l4_uint64_t arg0 = 0,
+                   l4_uint64_t arg1 = 0) const override
+  { _statistics->trace_event(type, arg0, arg1); }
 };
 
 } //Spmm
@@ -1,17 +1,41 @@
 #pragma once
 
+#include <list>
 #include <map>
+#include <mutex>
+#include <set>
+#include <vector>
 
 #include "memory.h"
+#include "policy.h"
 
 namespace Spmm
 {
 
+// the entries of a page only change while the page is locked (see
+// Spmm::Lock). the maps themselves are shared between the threads that operate
+// on different pages and are guarded by a mutex, which is never held while
+// calling into other components.
 class SimpleMemory : public Memory
 {
   typedef std::map<page_t , page_t> map_t;
+  // pages that share an immutable page, by immutable page.
+  typedef std::map<page_t, std::set<page_t>> sharers_t;
+  // sharers of an immutable page, by memory node.
+  typedef std::map<unsigned, std::list<page_t>> nodes_t;
+
+  enum
+  {
+    // maximum number of page pairs per kernel merge operation.
+    Max_merge_pairs = (L4_UTCB_GENERIC_DATA_SIZE - 2) / 2,
+  };
 private:
   map_t _page_map;
+  sharers_t _sharers;
+  // immutable page that discarded pages are merged with (allocated lazily).
+  // it is never freed, as no worker knows about it.
+  page_t _zero_page = 0;
+  std::mutex _mutex;
 
   void _unmap_page_from_others(page_t page)
   {
@@ -20,6 +44,16 @@ private:
     chksys(task->unmap(flexpage, L4_FP_OTHER_SPACES), "unmap page from others");
   }
 
+  // revoke only the write right, so that clients keep reading the page
+  // without faulting. the kernel keeps the mappings (and their size) intact.
+  void _write_protect_page_in_others(page_t page)
+  {
+    L4::Cap<L4::Task> const task = L4Re::Env::env()->task();
+    l4_fpage_t flexpage = l4_fpage(page, L4_LOG2_PAGESIZE, L4_FPAGE_W);
+    chksys(task->unmap(flexpage, L4_FP_OTHER_SPACES),
+           "write-protect page in others");
+  }
+
   bool _page_contents_match(page_t page1, page_t page2)
   {
     void const *ptr1 = reinterpret_cast<void const *>(page1);
@@ -35,37 +69,210 @@ private:
     memcpy(to_ptr, from_ptr, L4_PAGESIZE);
   }
 
-  void _map_imm_page(page_t imm_page, page_t page)
+  void _account_imm_page(page_t imm_page, page_t page)
   {
-    // free page that is going to be overmapped.
+    // bookkeeping.
+    {
+      std::lock_guard<std::mutex> const lock(_mutex);
+      _page_map[page] = imm_page;
+      _sharers[imm_page].insert(page);
+    }
+    manager->inc_pages_sharing(this, page, imm_page);
+
+    // free page that has been overmapped. this comes last, as it makes the
+    // statistics forget about the content of the volatile page.
     AllocatorFlags vol = Spmm::Allocator::F::VOLATILE;
     manager->free_page(this, vol, page);
+    //printf("merging 0x%08lX [0x%08lX --> 0x%08lX]\n", page, page, imm_page);
+  }
 
+  void _map_imm_page(page_t imm_page, page_t page)
+  {
     // map imm_page to page.
     L4::Cap<L4::Task> const task = L4Re::Env::env()->task();
     l4_fpage_t flexpage = l4_fpage(imm_page, L4_LOG2_PAGESIZE, L4_FPAGE_RO);
     chksys(task->map(L4Re::This_task, flexpage, page), "map imm_page to page");
 
-    // bookkeeping.
-    _page_map[page] = imm_page;
-    manager->inc_pages_sharing(this);
-    //printf("merging 0x%08lX [0x%08lX --> 0x%08lX]\n", page, page, imm_page);
+    _account_imm_page(imm_page, page);
   }
 
-  bool _is_merged_page(page_t page)
+  // let the kernel map each source page read-only to its destination page
+  // (given as pairs), if and only if the contents of both pages match.
+  // the kernel stops at the first pair that does not match and reports the
+  // reason in error.
+  // returns the number of merged pairs.
+  unsigned _merge_batch(page_t const *pairs, unsigned num_pairs, long *error)
   {
-    // search the page mapping relation.
-    map_t::iterator it = _page_map.begin();
-    while (it != _page_map.end())
+    l4_fpage_t flexpages[2 * Max_merge_pairs];
+    for (unsigned i = 0; i < 2 * num_pairs; i += 2)
     {
-      if (page == it->first)
-        return true;
-      it++;
+      flexpages[i] = l4_fpage(pairs[i], L4_LOG2_PAGESIZE, L4_FPAGE_RO);
+      flexpages[i + 1] = l4_fpage(pairs[i + 1], L4_LOG2_PAGESIZE, L4_FPAGE_RWX);
     }
-    // fallthrough.
-    return false;
+
+    L4::Cap<L4::Task> const task = L4Re::Env::env()->task();
+    unsigned merged = chksys(task->merge_batch(flexpages, num_pairs),
+                             "merge pages");
+    *error = L4_EOK;
+    if (merged < num_pairs)
+      *error = static_cast<long>(l4_utcb_mr()->mr[1]);
+    return merged;
   }
 
+  void _relocate_imm_page(page_t imm_page)
+  {
+    // there is nowhere to relocate to without pools that are bound to nodes.
+    if (!manager->has_node_page(this, Policy::Any_node))
+      return;
+
+    // the zero page stays where it is, it has no sharers worth following.
+    std::vector<page_t> sharers;
+    {
+      std::lock_guard<std::mutex> const lock(_mutex);
+      sharers_t::iterator it = _sharers.find(imm_page);
+      if (imm_page == _zero_page || it == _sharers.end())
+        return;
+      sharers.assign(it->second.begin(), it->second.end());
+    }
+
+    // count the sharers of imm_page per memory node.
+    nodes_t nodes;
+    for (page_t page : sharers)
+      nodes[manager->get_node(this, page)].push_back(page);
+
+    // find the node that most of the sharers run on.
+    unsigned imm_node = manager->get_node(this, imm_page);
+    nodes_t::iterator majority = nodes.end();
+    for (nodes_t::iterator it = nodes.begin(); it != nodes.end(); it++)
+    {
+      if (it->first == Policy::Any_node)
+        continue;
+      if (majority == nodes.end()
+          || it->second.size() > majority->second.size())
+        majority = it;
+    }
+
+    // only relocate if the majority clearly moved to another node.
+    if (majority == nodes.end() || majority->first == imm_node)
+      return;
+    nodes_t::iterator current = nodes.find(imm_node);
+    if (current != nodes.end()
+        && current->second.size() >= majority->second.size())
+      return;
+
+    // every sharer has to stay merged while it is remapped. the caller holds
+    // some of them already, so back off if any of the others is busy.
+    unsigned locked = 0;
+    while (locked < sharers.size()
+           && manager->try_lock_page(this, sharers[locked]))
+      locked++;
+
+    // pages that joined before their locks were taken are not part of the
+    // snapshot. as none can leave while locked, comparing sizes suffices.
+    bool complete = (locked == sharers.size());
+    if (complete)
+    {
+      std::lock_guard<std::mutex> const lock(_mutex);
+      complete = (_sharers[imm_page].size() == sharers.size());
+    }
+
+    // obtain a page from the pool of that node, unless it is exhausted.
+    if (complete && manager->has_node_page(this, majority->first))
+      _move_imm_page(imm_page, majority->second.front(), nodes);
+
+    for (unsigned i = 0; i < locked; i++)
+      manager->unlock_page(this, sharers[i]);
+  }
+
+  void _move_imm_page(page_t imm_page, l4_addr_t hint, nodes_t &nodes)
+  {
+    AllocatorFlags imm_flags = Spmm::Allocator::F::IMMUTABLE;
+    page_t new_imm_page = manager->allocate_page(this, imm_flags, hint);
+    _copy_page_contents(imm_page, new_imm_page);
+
+    // remap every sharer, as many per kernel operation as possible.
+    std::list<page_t> pages;
+    for (nodes_t::value_type &node : nodes)
+      pages.splice(pages.end(), node.second);
+
+    while (!pages.empty())
+    {
+      page_t pairs[2 * Max_merge_pairs];
+      unsigned num_pairs = 0;
+      for (; num_pairs < Max_merge_pairs && !pages.empty(); num_pairs++)
+      {
+        pairs[2 * num_pairs] = new_imm_page;
+        pairs[2 * num_pairs + 1] = pages.front();
+        pages.pop_front();
+      }
+
+      // the contents cannot differ, as every sharer is mapped read-only.
+      long error;
+      if (_merge_batch(pairs, num_pairs, &error) != num_pairs)
+        chksys(error, "relocate: merge new imm_page with page");
+
+      {
+        std::lock_guard<std::mutex> const lock(_mutex);
+        for (unsigned i = 0; i < num_pairs; i++)
+        {
+          page_t page = pairs[2 * i + 1];
+          _page_map[page] = new_imm_page;
+          _sharers[new_imm_page].insert(page);
+        }
+      }
+      for (unsigned i = 0; i < num_pairs; i++)
+      {
+        page_t page = pairs[2 * i + 1];
+        manager->dec_pages_sharing(this, page, imm_page);
+        manager->inc_pages_sharing(this, page, new_imm_page);
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> const lock(_mutex);
+      _sharers.erase(imm_page);
+    }
+    manager->free_page(this, imm_flags, imm_page);
+  }
+
+  // remove a page that has been mapped over from the sharers of its
+  // immutable page.
+  void _drop_imm_page(page_t page)
+  {
+    // bookkeeping. this comes first, as another sharer might free the
+    // immutable page as soon as the worker has been notified.
+    page_t imm_page;
+    {
+      std::lock_guard<std::mutex> const lock(_mutex);
+      imm_page = _page_map[page];
+      _sharers[imm_page].erase(page);
+      if (_sharers[imm_page].empty())
+        _sharers.erase(imm_page);
+      _page_map.erase(page);
+    }
+    manager->dec_pages_sharing(this, page, imm_page);
+
+    // notify worker of unmerge operation.
+    bool should_free = manager->page_unmerge_notification(this, page);
+    if (should_free)
+    {
+      // free immutable page if requested by worker.
+      AllocatorFlags imm_flags = Spmm::Allocator::F::IMMUTABLE;
+      manager->free_page(this, imm_flags, imm_page);
+    }
+  }
+
+  // returns the immutable page that page is merged with, or 0.
+  page_t _imm_page_of(page_t page)
+  {
+    std::lock_guard<std::mutex> const lock(_mutex);
+    map_t::const_iterator it = _page_map.find(page);
+    return it != _page_map.end() ? it->second : 0;
+  }
+
+  bool _is_merged_page(page_t page)
+  { return _imm_page_of(page) != 0; }
+
 public:
 
   long merge_pages(page_t page1, page_t page2, MemoryFlags flags) override
@@ -81,35 +288,51 @@ public:
     //else if (page2_merged || (flags.vol() == page1_merged))
     //  return -L4_EFAULT;
 
-    // unmap pages, if necessary.
-    if (flags.vol())
-      _unmap_page_from_others(page1);
-    _unmap_page_from_others(page2);
-
-    // make sure page contents still match.
-    if (!_page_contents_match(page1, page2))
-      return -L4_EFAULT;
-
     // check flags for case distinction (volatile/immutable).
     if (flags.imm())
     {
       // retrieve the actual immutable page here because we don't do transitive
       // mappings.
-      page_t imm_page = _page_map[page1];
+      page_t imm_page = _imm_page_of(page1);
+      if (!imm_page)
+        return -L4_EINVAL;
+
+      // let the kernel do the map, if page contents still match.
+      page_t pairs[] = { imm_page, page2 };
+      long error;
+      if (!_merge_batch(pairs, 1, &error))
+        return error;
+      _account_imm_page(imm_page, page2);
 
-      // do the map.
-      _map_imm_page(imm_page, page2);
+      // move imm_page closer to its sharers, if necessary.
+      _relocate_imm_page(imm_page);
     }
     else //if (flags.vol())
     {
+      // freeze page1, so that its content remains the same until it is
+      // merged. readers keep their mappings, in case the merge fails.
+      _write_protect_page_in_others(page1);
+
       // prepare new immutable page because we don't have one yet.
       AllocatorFlags imm_flags = Spmm::Allocator::F::IMMUTABLE;
-      page_t imm_page = manager->allocate_page(this, imm_flags, /* hint: */ 0);
+      page_t imm_page = manager->allocate_page(this, imm_flags,
+                                               /* hint: */ page1);
       _copy_page_contents(page1, imm_page);
 
-      // do the maps.
-      _map_imm_page(imm_page, page1);
-      _map_imm_page(imm_page, page2);
+      // let the kernel do the maps, if page contents still match.
+      // page2 goes first, the frozen page1 is bound to match afterwards.
+      page_t pairs[] = { imm_page, page2, imm_page, page1 };
+      long error;
+      unsigned merged = _merge_batch(pairs, 2, &error);
+      if (!merged)
+      {
+        manager->free_page(this, imm_flags, imm_page);
+        return error;
+      }
+      else if (merged != 2)
+        chksys(error, "merge imm_page with frozen page");
+      _account_imm_page(imm_page, page1);
+      _account_imm_page(imm_page, page2);
     }
 
     return L4_EOK;
@@ -135,28 +358,83 @@ public:
     chksys(L4Re::Env::env()->task()->map(L4Re::This_task, flexpage, page),
            "unmerge: map volatile page to page");
 
-    // notify worker of unmerge operation.
-    bool should_free = manager->page_unmerge_notification(this, page);
-    if (should_free)
-    {
-      // free immutable page if requested by worker.
-      page_t imm_page = _page_map[page];
-      AllocatorFlags imm_flags = Spmm::Allocator::F::IMMUTABLE;
-      manager->free_page(this, imm_flags, imm_page);
-    }
-
     //printf("unmerging 0x%08lX [0x%08lX --> 0x%08lX (internal: 0x%08lX)]\n",
-    //       page, _page_map[page], page, vol_page);
+    //       page, _imm_page_of(page), page, vol_page);
 
-    // bookkeeping.
-    _page_map.erase(page);
-    manager->dec_pages_sharing(this);
+    _drop_imm_page(page);
 
     return L4_EOK;
   }
 
   bool is_merged_page(page_t page) override
   { return _is_merged_page(page); }
+
+  long discard_page(page_t page, bool zero_only = false) override
+  {
+    // sanitize.
+    bool page_merged = _is_merged_page(page);
+    if (page != l4_trunc_page(page))
+      return -L4_EINVAL;
+    else if (page_merged && zero_only)
+      return -L4_EEXIST;
+    else if (!page_merged && !manager->may_merge_page(this, page))
+      return -L4_EPERM;
+
+    // prepare the shared zero page, if necessary. the allocator does not call
+    // back into this component, so the mutex can be held meanwhile.
+    page_t zero_page;
+    {
+      std::lock_guard<std::mutex> const lock(_mutex);
+      if (!_zero_page)
+      {
+        AllocatorFlags imm_flags = Spmm::Allocator::F::IMMUTABLE;
+        _zero_page = manager->allocate_page(this, imm_flags, /* hint: */ page);
+        memset(reinterpret_cast<void *>(_zero_page), 0, L4_PAGESIZE);
+      }
+      zero_page = _zero_page;
+    }
+
+    // a merged page is read-only in its clients, so it simply stops sharing its
+    // immutable page. mapping over it revokes the mappings in the clients.
+    if (page_merged)
+    {
+      if (_imm_page_of(page) == zero_page)
+        return L4_EOK;
+      L4::Cap<L4::Task> const task = L4Re::Env::env()->task();
+      l4_fpage_t flexpage = l4_fpage(zero_page, L4_LOG2_PAGESIZE, L4_FPAGE_RO);
+      chksys(task->map(L4Re::This_task, flexpage, page),
+             "discard: map zero page to merged page");
+      _drop_imm_page(page);
+      {
+        std::lock_guard<std::mutex> const lock(_mutex);
+        _page_map[page] = zero_page;
+        _sharers[zero_page].insert(page);
+      }
+      manager->inc_pages_sharing(this, page, zero_page);
+      manager->page_discard_notification(this, page);
+      return L4_EOK;
+    }
+
+    // the client might still write to a page that is supposed to be zero, so
+    // let the kernel do the map, if the page is still zero-filled.
+    if (zero_only)
+    {
+      page_t pairs[] = { zero_page, page };
+      long error;
+      if (!_merge_batch(pairs, 1, &error))
+        return error;
+      _account_imm_page(zero_page, page);
+      manager->page_discard_notification(this, page);
+      return L4_EOK;
+    }
+
+    // do the map.
+    _unmap_page_from_others(page);
+    _map_imm_page(zero_page, page);
+    manager->page_discard_notification(this, page);
+
+    return L4_EOK;
+  }
 };
 
 } //Spmm
@@ -1,40 +1,109 @@
 #pragma once
 
 #include <list>
+#include <mutex>
 
+#include "policy.h"
 #include "queue.h"
 
 namespace Spmm
 {
 
-// simple wrapper implementing the queue interface around a standard library
-// list.
+// simple wrapper implementing the queue interface around standard library
+// lists.
+// pages are kept in one list per scan priority (see Spmm::Policy). the lists
+// are visited in a weighted round-robin fashion, where a list of priority p
+// hands out up to 2^p pages per round.
+// prioritised pages are handed out before any of these lists are visited.
 class SimpleQueue : public Queue
 {
   typedef std::list<page_t> list_t;
+
+  struct level_t
+  {
+    list_t list;
+    list_t::iterator next_page;
+    // whether this list was wrapped since the last full scan.
+    bool wrapped;
+  };
 private:
-  list_t _list;
-  list_t::iterator _next_page;
+  // pages are registered and unregistered by the threads that serve the
+  // clients, concurrently to the worker.
+  level_t _levels[Policy::Max_priority + 1];
+  unsigned _current_level = 0;
+  unsigned _pages_from_level = 0;
+  std::mutex _levels_m;
+  // prioritised pages can be reported concurrently to the worker.
+  list_t _prioritized;
+  std::mutex _prioritized_m;
+
+  unsigned _level_of(page_t page)
+  {
+    Policy const *policy = manager->get_policy(this, page);
+    if (!policy)
+      return Policy::Default_priority;
+    return policy->priority;
+  }
+
+  bool _empty(void)
+  {
+    for (level_t &level : _levels)
+      if (!level.list.empty())
+        return false;
+    return true;
+  }
+
+  void _check_full_scan(void)
+  {
+    // a full scan is complete once every non-empty list has been wrapped.
+    if (_empty())
+      return;
+    for (level_t &level : _levels)
+      if (!level.list.empty() && !level.wrapped)
+        return;
+
+    for (level_t &level : _levels)
+      level.wrapped = false;
+    manager->inc_full_scans(this);
+  }
 
-  void _increment_next_page(void)
+  void _increment_next_page(level_t &level)
   {
     // increment internal iterator.
-    _next_page++;
+    level.next_page++;
     // wrap internal iterator and update statistics, if needed.
-    if (_next_page == _list.end())
+    if (level.next_page == level.list.end())
     {
-      _next_page = _list.begin();
-      manager->inc_full_scans(this);
+      level.next_page = level.list.begin();
+      level.wrapped = true;
+      _check_full_scan();
     }
   }
 
+  void _next_level(void)
+  {
+    _current_level = (_current_level + 1) % (Policy::Max_priority + 1);
+    _pages_from_level = 0;
+  }
+
 public:
-  SimpleQueue() { _next_page = _list.begin(); }
+  SimpleQueue()
+  {
+    for (level_t &level : _levels)
+    {
+      level.next_page = level.list.begin();
+      level.wrapped = false;
+    }
+  }
 
   void register_page(page_t page) override
   {
+    unsigned level_idx = _level_of(page);
+    std::lock_guard<std::mutex> guard(_levels_m);
+    level_t &level = _levels[level_idx];
+
     // check if page is already in the list.
-    //for (page_t &p : _list)
+    //for (page_t &p : level.list)
     //  if (page == p) return;
 
     // check if page is already merged.
@@ -42,17 +111,27 @@ public:
     //  return;
 
     // insert page.
-    _list.push_back(page);
+    level.list.push_back(page);
 
     // update internal iterator, if necessary.
-    if (_list.size() == 1)
-      _next_page = _list.begin();
+    if (level.list.size() == 1)
+      level.next_page = level.list.begin();
   }
 
   void unregister_page(page_t page) override
   {
+    // a page that is gone must not be handed out anymore.
+    {
+      std::lock_guard<std::mutex> guard(_prioritized_m);
+      _prioritized.remove(page);
+    }
+
+    unsigned level_idx = _level_of(page);
+    std::lock_guard<std::mutex> guard(_levels_m);
+    level_t &level = _levels[level_idx];
+
     // empty list is never accessed.
-    if (_list.empty())
+    if (level.list.empty())
       return;
 
     // if currently merged then unmerge page
@@ -62,23 +141,56 @@ public:
     //}
 
     // else check if we need to move internal iterator.
-    if (*_next_page == page)
-      _increment_next_page();
+    if (*level.next_page == page)
+      _increment_next_page(level);
 
     // remove page.
-    _list.remove(page);
+    level.list.remove(page);
+
+    // a list that just became empty no longer delays full scans.
+    if (level.list.empty())
+    {
+      level.next_page = level.list.begin();
+      _check_full_scan();
+    }
   }
 
   page_t get_next_page(void) override
   {
-    // empty list is never accessed.
-    if (_list.empty())
+    // serve prioritised pages first.
+    {
+      std::lock_guard<std::mutex> guard(_prioritized_m);
+      if (!_prioritized.empty())
+      {
+        page_t page = _prioritized.front();
+        _prioritized.pop_front();
+        return page;
+      }
+    }
+
+    std::lock_guard<std::mutex> guard(_levels_m);
+
+    // empty queue is never accessed.
+    if (_empty())
       return 0;
 
-    page_t page = *_next_page;
-    _increment_next_page();
+    // skip lists that are empty or that have used up their share of this round.
+    while (_levels[_current_level].list.empty()
+           || _pages_from_level >= (1U << _current_level))
+      _next_level();
+
+    level_t &level = _levels[_current_level];
+    page_t page = *level.next_page;
+    _pages_from_level++;
+    _increment_next_page(level);
     return page;
   }
+
+  void prioritize_page(page_t page) override
+  {
+    std::lock_guard<std::mutex> guard(_prioritized_m);
+    _prioritized.push_back(page);
+  }
 };
 
 } //Spmm
@@ -1,24 +1,124 @@
 #pragma once
 
+#include <l4/re/env>
+#include <l4/spmm/statistics>
+#include <l4/sys/cxx/ipc_epiface>
+#include <l4/sys/task>
+
+#include <algorithm>
 #include <chrono>
+#include <map>
 #include <mutex>
+#include <utility>
 
 #include "statistics.h"
+#include "trace-buffer.h"
 
 namespace Spmm
 {
 
-class SimpleStatistics : public Statistics
+// statistics component that additionally breaks the counters down per client
+// and per content class, and provides them through the Spmm::Stats interface.
+// zero-filled immutable pages are classified by their content, any other
+// immutable page by the origin that other components reported for one of its
+// sharers.
+// merges, unmerges, page faults and the reported events are recorded in a
+// trace buffer, which readers obtain through the Spmm::Stats interface too.
+// the periodic report of the counters goes into the trace buffer as well, so
+// that reporting never waits for the console.
+class SimpleStatistics : public Statistics,
+                         public L4::Epiface_t<SimpleStatistics, Spmm::Stats>
 {
+  struct client_counters_t
+  {
+    l4_uint64_t pages_sharing;
+    l4_uint64_t pages_unshared;
+  };
+
+  struct class_counters_t
+  {
+    l4_uint64_t pages_shared;
+    l4_uint64_t pages_sharing;
+  };
+
+  // content class and number of sharing pages (in total and per client) of an
+  // immutable page.
+  struct imm_page_t
+  {
+    unsigned cls;
+    l4_uint64_t pages;
+    std::map<client_t, l4_uint64_t> sharers;
+  };
+
+  typedef std::map<client_t, client_counters_t> clients_t;
+  typedef std::map<std::pair<client_t, client_t>, l4_uint64_t> pairs_t;
+  typedef std::map<page_t, imm_page_t> imm_pages_t;
+  typedef std::map<page_t, unsigned> origins_t;
 private:
   // counters
   l4_uint64_t _pages_shared   = 0;
   l4_uint64_t _pages_sharing  = 0;
   l4_uint64_t _pages_unshared = 0;
   l4_uint64_t _full_scans     = 0;
+  // served page faults since the last report
+  l4_uint64_t _faults         = 0;
+  l4_uint64_t _fault_us       = 0;
+  // detailed counters
+  clients_t        _clients;
+  class_counters_t _classes[Spmm::Stats::Num_classes] = {};
+  pairs_t          _pairs;
+  imm_pages_t      _imm_pages;
+  // content classes of the volatile pages with a known origin. entries are
+  // taken once the page gets merged and dropped once it stops being volatile.
+  origins_t        _origins;
+  // trace of individual events, recorded without synchronisation.
+  TraceBuffer      _trace;
   // internal synchronisation
   std::mutex _mutex;
 
+  bool _is_zero_page(page_t page)
+  {
+    l4_uint64_t const *array = reinterpret_cast<l4_uint64_t const *>(page);
+    l4_size_t array_size = L4_PAGESIZE / sizeof(l4_uint64_t);
+    for (l4_size_t i = 0; i < array_size; i++)
+      if (array[i])
+        return false;
+    return true;
+  }
+
+  // the reported origin of a page that is about to be merged.
+  unsigned _take_origin(page_t page)
+  {
+    origins_t::iterator origin = _origins.find(page);
+    if (origin == _origins.end())
+      return Spmm::Stats::Class_other;
+
+    unsigned cls = origin->second;
+    _origins.erase(origin);
+    return cls;
+  }
+
+  void _move_to_class(imm_page_t &imm, unsigned cls)
+  {
+    _classes[imm.cls].pages_shared--;
+    _classes[imm.cls].pages_sharing -= imm.pages;
+    imm.cls = cls;
+    _classes[imm.cls].pages_shared++;
+    _classes[imm.cls].pages_sharing += imm.pages;
+  }
+
+  void _add_pair(client_t client1, client_t client2, long delta)
+  {
+    std::pair<client_t, client_t> key(std::min(client1, client2),
+                                      std::max(client1, client2));
+    _pairs[key] += delta;
+    if (!_pairs[key])
+      _pairs.erase(key);
+  }
+
+  client_t _num_clients(void)
+  { return _clients.empty() ? 0 : _clients.rbegin()->first + 1; }
+
   void _get_stats()
   {
     time_t my_time = time(NULL);
@@ -46,18 +146,50 @@ private:
     return ms;
   }
 
+  // kernel memory in use and its high-water mark in KiB, both 0 if the
+  // kernel does not report them (see patch/kmem.patch).
+  void _get_kmem(unsigned long *used, unsigned long *peak)
+  {
+    *used = *peak = 0;
+#ifdef L4_TASK_HAVE_KMEM_INFO
+    l4_task_kmem_info_t info;
+    if (l4_error(L4Re::Env::env()->task()->kmem_info(&info)) < 0)
+      return;
+
+    *used = info.kmem_current / 1024;
+    *peak = info.kmem_peak / 1024;
+#endif
+  }
+
 public:
   void report(void)
   {
-    printf("time, pages_unshared, pages_saved, pages_shared, full_scans\n");
     while(true)
     {
+      unsigned long kmem_used, kmem_peak;
+      _get_kmem(&kmem_used, &kmem_peak);
+
+      // take a consistent snapshot, the trace records outside of the lock.
+      l4_uint64_t shared, sharing, unshared, full_scans, faults, fault_us;
       {
         std::lock_guard<std::mutex> const lock(_mutex);
-        printf("%lu, %llu, %llu, %llu, %llu\n", _get_current_time_in_ms(),
-               _pages_unshared, _pages_sharing - _pages_shared, _pages_shared,
-               _full_scans);
+        shared     = _pages_shared;
+        sharing    = _pages_sharing;
+        unshared   = _pages_unshared;
+        full_scans = _full_scans;
+        faults     = _faults;
+        fault_us   = _fault_us;
+        _faults = _fault_us = 0;
       }
+
+      _trace.record(L4SPMM_TRACE_REPORT_PAGES, invalid_client, shared,
+                    sharing);
+      _trace.record(L4SPMM_TRACE_REPORT_SCANS, invalid_client, unshared,
+                    full_scans);
+      _trace.record(L4SPMM_TRACE_REPORT_KMEM, invalid_client, kmem_used,
+                    kmem_peak);
+      _trace.record(L4SPMM_TRACE_REPORT_FAULTS, invalid_client, faults,
+                    fault_us);
       l4_sleep(5000);
     }
   }
@@ -74,28 +206,108 @@ public:
     _pages_shared--;
   }
 
-  void inc_pages_sharing(void) override
+  void inc_pages_sharing(page_t page, page_t imm_page) override
   {
+    client_t client = manager->get_client(this, page);
+    _trace.record(L4SPMM_TRACE_MERGE, client, page, imm_page);
     std::lock_guard<std::mutex> const lock(_mutex);
     _pages_sharing++;
+    if (client != invalid_client)
+      _clients[client].pages_sharing++;
+
+    // classify immutable page on first use, or once the origin of its content
+    // becomes known.
+    unsigned origin = _take_origin(page);
+    imm_pages_t::iterator imm = _imm_pages.find(imm_page);
+    if (imm == _imm_pages.end())
+    {
+      unsigned cls = origin;
+      if (_is_zero_page(imm_page))
+        cls = Spmm::Stats::Class_zero;
+      imm = _imm_pages.insert({imm_page, {cls, 0, {}}}).first;
+      _classes[cls].pages_shared++;
+    }
+    else if (imm->second.cls == Spmm::Stats::Class_other
+             && origin != Spmm::Stats::Class_other)
+      _move_to_class(imm->second, origin);
+    _classes[imm->second.cls].pages_sharing++;
+    imm->second.pages++;
+
+    // pages that belong to no client share with no one.
+    if (client == invalid_client)
+      return;
+
+    // the client now shares imm_page with every other of its sharers.
+    l4_uint64_t &count = imm->second.sharers[client];
+    if (count == 0)
+    {
+      for (auto const &sharer : imm->second.sharers)
+        if (sharer.first != client)
+          _add_pair(client, sharer.first, +1);
+    }
+    else if (count == 1)
+      _add_pair(client, client, +1);
+    count++;
   }
 
-  void dec_pages_sharing(void) override
+  void dec_pages_sharing(page_t page, page_t imm_page) override
   {
+    client_t client = manager->get_client(this, page);
+    _trace.record(L4SPMM_TRACE_UNMERGE, client, page, imm_page);
     std::lock_guard<std::mutex> const lock(_mutex);
     _pages_sharing--;
+    if (client != invalid_client)
+      _clients[client].pages_sharing--;
+
+    imm_pages_t::iterator imm = _imm_pages.find(imm_page);
+    if (imm == _imm_pages.end())
+      return;
+    _classes[imm->second.cls].pages_sharing--;
+    imm->second.pages--;
+
+    // the client might no longer share imm_page with the other sharers.
+    if (client != invalid_client)
+    {
+      l4_uint64_t &count = imm->second.sharers[client];
+      count--;
+      if (count == 0)
+      {
+        imm->second.sharers.erase(client);
+        for (auto const &sharer : imm->second.sharers)
+          _add_pair(client, sharer.first, -1);
+      }
+      else if (count == 1)
+        _add_pair(client, client, -1);
+    }
+
+    // forget about immutable page once it is no longer shared.
+    if (!imm->second.pages)
+    {
+      _classes[imm->second.cls].pages_shared--;
+      _imm_pages.erase(imm);
+    }
   }
 
-  void inc_pages_unshared(void) override
+  void inc_pages_unshared(page_t page) override
   {
+    client_t client = manager->get_client(this, page);
     std::lock_guard<std::mutex> const lock(_mutex);
     _pages_unshared++;
+    if (client != invalid_client)
+      _clients[client].pages_unshared++;
   }
 
-  void dec_pages_unshared(void) override
+  void dec_pages_unshared(page_t page) override
   {
+    client_t client = manager->get_client(this, page);
     std::lock_guard<std::mutex> const lock(_mutex);
     _pages_unshared--;
+    if (client != invalid_client)
+      _clients[client].pages_unshared--;
+
+    // the page is merged or discarded, an origin that was reported for it
+    // meanwhile is of no use anymore.
+    _origins.erase(page);
   }
 
   void inc_full_scans(void) override
@@ -104,6 +316,85 @@ public:
     _full_scans++;
     //this->_get_stats();
   }
+
+  void set_content_class(page_t page, unsigned cls) override
+  {
+    if (cls >= Spmm::Stats::Num_classes)
+      return;
+    std::lock_guard<std::mutex> const lock(_mutex);
+    _origins[page] = cls;
+  }
+
+  void add_fault(client_t client, l4_uint64_t latency_us) override
+  {
+    _trace.record(L4SPMM_TRACE_FAULT, client, latency_us);
+    std::lock_guard<std::mutex> const lock(_mutex);
+    _faults++;
+    _fault_us += latency_us;
+  }
+
+  void trace_event(l4spmm_trace_event_type type, l4_uint64_t arg0,
+                   l4_uint64_t arg1) override
+  { _trace.record(type, invalid_client, arg0, arg1); }
+
+  // implementation of the Spmm::Stats interface.
+
+  long op_global_stats(Spmm::Stats::Rights, l4_uint64_t &pages_shared,
+                       l4_uint64_t &pages_sharing, l4_uint64_t &pages_unshared,
+                       l4_uint64_t &full_scans, unsigned &clients,
+                       unsigned &classes)
+  {
+    std::lock_guard<std::mutex> const lock(_mutex);
+    pages_shared   = _pages_shared;
+    pages_sharing  = _pages_sharing;
+    pages_unshared = _pages_unshared;
+    full_scans     = _full_scans;
+    clients        = _num_clients();
+    classes        = Spmm::Stats::Num_classes;
+    return L4_EOK;
+  }
+
+  long op_client_stats(Spmm::Stats::Rights, unsigned client,
+                       l4_uint64_t &pages_sharing, l4_uint64_t &pages_unshared)
+  {
+    std::lock_guard<std::mutex> const lock(_mutex);
+    if (client >= _num_clients())
+      return -L4_ENOENT;
+    clients_t::iterator it = _clients.find(client);
+    pages_sharing  = (it != _clients.end()) ? it->second.pages_sharing : 0;
+    pages_unshared = (it != _clients.end()) ? it->second.pages_unshared : 0;
+    return L4_EOK;
+  }
+
+  long op_class_stats(Spmm::Stats::Rights, unsigned cls,
+                      l4_uint64_t &pages_shared, l4_uint64_t &pages_sharing)
+  {
+    std::lock_guard<std::mutex> const lock(_mutex);
+    if (cls >= Spmm::Stats::Num_classes)
+      return -L4_ENOENT;
+    pages_shared  = _classes[cls].pages_shared;
+    pages_sharing = _classes[cls].pages_sharing;
+    return L4_EOK;
+  }
+
+  long op_pair_stats(Spmm::Stats::Rights, unsigned client1, unsigned client2,
+                     l4_uint64_t &pages_shared)
+  {
+    std::lock_guard<std::mutex> const lock(_mutex);
+    if (client1 >= _num_clients() || client2 >= _num_clients())
+      return -L4_ENOENT;
+    pairs_t::iterator it = _pairs.find({std::min(client1, client2),
+                                        std::max(client1, client2)});
+    pages_shared = (it != _pairs.end()) ? it->second : 0;
+    return L4_EOK;
+  }
+
+  long op_trace_buffer(Spmm::Stats::Rights, L4::Ipc::Cap<L4Re::Dataspace> &ds)
+  {
+    // the reader advances the tails of the rings.
+    ds = L4::Ipc::make_cap_rw(_trace.dataspace());
+    return L4_EOK;
+  }
 };
 
 } //Spmm
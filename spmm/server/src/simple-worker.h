@@ -1,13 +1,17 @@
 #pragma once
 
 #include <l4/re/error_helper>
+#include <l4/spmm/statistics>
 #include <l4/util/util.h>
 
-#include <chrono>
 #include <cstring>
 #include <list>
 #include <map>
+#include <mutex>
+#include <vector>
 
+#include "policy.h"
+#include "volatility-tracker.h"
 #include "worker.h"
 
 using L4Re::chksys;
@@ -18,6 +22,12 @@ namespace Spmm
 // simple worker class that continuously scans X pages and then sleeps for Y
 // seconds (both X and Y are configurable).
 // it performs only primitive bookkeeping of merged pages and merge candidates.
+// pages are fetched from the queue in batches, so that their dirty state can
+// be harvested from the kernel at once (see Spmm::VolatilityTracker). pages
+// that the kernel reports as written to are skipped without reading them, all
+// other pages are checked by their checksums.
+// a page is merged with a candidate only if the candidate can be locked right
+// away (see Spmm::Lock), busy candidates are skipped.
 class SimpleWorker : public Worker
 {
   // primitive checksum of a page (sum of its content).
@@ -26,15 +36,50 @@ class SimpleWorker : public Worker
 
   // this workers collection of already encountered volatile pages and their
   // then checksums.
-  // gets reset after every pass.
+  // gets reset after every pass. only ever touched by the worker thread.
   typedef std::map<page_t, checksum_t> volatile_pages_t;
 
   // this workers collection of merged immutable pages.
-  // persists across passes.
+  // persists across passes. shared with the threads that serve the clients.
   typedef std::list<std::list<page_t>> immutable_pages_t;
+
+  // this workers collection of pages whose clients require them to remain
+  // unchanged for a number of scans before merging (see Spmm::Policy).
+  // persists across passes. only ever touched by the worker thread.
+  struct page_age_t
+  {
+    checksum_t checksum;
+    unsigned   scans;
+  };
+  typedef std::map<page_t, page_age_t> page_ages_t;
+
+  // this workers collection of pages that were loaded from a known source
+  // (see merge_loaded_page()), by source and offset within the source.
+  // persists across passes, an entry is dropped once its candidate has been
+  // discarded or its merged pages are all gone. shared with the threads that
+  // serve the clients.
+  struct loaded_page_t
+  {
+    // first page loaded from there, merge candidate for the following ones.
+    page_t page = 0;
+    // the list of immutable pages that the loaded pages were merged into.
+    std::list<page_t> *merged = nullptr;
+  };
+  typedef std::pair<l4_uint64_t, l4_addr_t> loaded_source_t;
+  typedef std::map<loaded_source_t, loaded_page_t> loaded_pages_t;
+
+  // the merge candidates of the loaded pages, by page.
+  typedef std::map<page_t, loaded_source_t> loaded_candidates_t;
 private:
   volatile_pages_t  _volatile_pages;
   immutable_pages_t _immutable_pages;
+  page_ages_t       _page_ages;
+  loaded_pages_t    _loaded_pages;
+  loaded_candidates_t _loaded_candidates;
+  // protects the shared collections, never held while calling other
+  // components.
+  std::mutex        _mutex;
+  VolatilityTracker _tracker;
   l4_uint64_t       _pages_to_scan;
   l4_uint64_t       _sleep_duration;
 
@@ -60,32 +105,97 @@ private:
     return match;
   }
 
+  void _set_loaded_candidate(loaded_source_t const &source, page_t page)
+  {
+    loaded_page_t &loaded = _loaded_pages[source];
+
+    // the old candidate might have become the candidate of another source.
+    loaded_candidates_t::iterator old = _loaded_candidates.find(loaded.page);
+    if (old != _loaded_candidates.end() && old->second == source)
+      _loaded_candidates.erase(old);
+
+    loaded.page = page;
+    if (page)
+      _loaded_candidates[page] = source;
+  }
+
+  void _drop_loaded_pages(std::list<page_t> const *merged)
+  {
+    loaded_pages_t::iterator loaded = _loaded_pages.begin();
+    while (loaded != _loaded_pages.end())
+    {
+      if (loaded->second.merged != merged)
+      {
+        loaded++;
+        continue;
+      }
+      _set_loaded_candidate(loaded->first, 0);
+      loaded = _loaded_pages.erase(loaded);
+    }
+  }
+
+  // returns the list that candidate represents, if any. requires the mutex.
+  immutable_pages_t::value_type *_find_list(page_t candidate)
+  {
+    for (immutable_pages_t::value_type &list : _immutable_pages)
+      if (list.front() == candidate)
+        return &list;
+    // fallthrough.
+    return nullptr;
+  }
+
+  // merge page with the immutable page of the list that candidate represents.
+  // both pages are locked by the caller, so the list stays in place.
+  long _merge_with_list(page_t candidate, page_t page)
+  {
+    // the candidate might have left its list while it was not locked.
+    {
+      std::lock_guard<std::mutex> const lock(_mutex);
+      if (!_find_list(candidate))
+        return -L4_ENOENT;
+    }
+
+    MemoryFlags flags = Spmm::Memory::F::MERGE_IMMUTABLE;
+    long error = manager->merge_pages(this, candidate, page, flags);
+    if (error != L4_EOK)
+      return error;
+
+    std::lock_guard<std::mutex> const lock(_mutex);
+    _find_list(candidate)->push_back(page);
+    return L4_EOK;
+  }
+
   bool _try_immutable_pages(page_t page)
   {
     bool const successful = true;
-    for (immutable_pages_t::value_type &list : _immutable_pages)
+
+    // all pages in a list have the same content.
+    // pick first as representative.
+    std::vector<page_t> candidates;
     {
-      // all pages in the list have the same content.
-      // pick first as representative.
-      page_t candidate = list.front();
+      std::lock_guard<std::mutex> const lock(_mutex);
+      for (immutable_pages_t::value_type &list : _immutable_pages)
+        candidates.push_back(list.front());
+    }
 
-      //if (page == candidate)
-      //  continue;
+    for (page_t candidate : candidates)
+    {
+      if (!_page_contents_match(page, candidate))
+        continue;
 
-      if (_page_contents_match(page, candidate))
-      {
-        // match found, proceed to merge.
-        MemoryFlags flags = Spmm::Memory::F::MERGE_IMMUTABLE;
-        long error = manager->merge_pages(this, candidate, page, flags);
-        if (error != L4_EOK)
-          return !successful;
+      // match found, proceed to merge.
+      if (!manager->try_lock_page(this, candidate))
+        continue;
+      long error = _merge_with_list(candidate, page);
+      manager->unlock_page(this, candidate);
+      if (error != L4_EOK)
+        return !successful;
 
-        // merge was successful, update page collections.
-        _volatile_pages.erase(page);
-        list.push_back(page);
+      // merge was successful, update page collections.
+      _volatile_pages.erase(page);
+      _page_ages.erase(page);
 
-        return successful;
-      }
+      return successful;
     }
     // fallthrough.
     return !successful;
@@ -100,18 +210,47 @@ private:
       if (candidate == page)
         continue;
 
+      // the client of the candidate might have exhausted its share. a merge
+      // within a single client adds two of its pages at once.
+      bool same_client = manager->get_client(this, candidate)
+                         == manager->get_client(this, page);
+      if (!manager->may_merge_page(this, candidate, same_client ? 2 : 1))
+        continue;
+
+      // the candidate might have been discarded in the meantime.
+      if (manager->is_merged_page(this, candidate))
+        continue;
+
       if (_page_contents_match(page, candidate))
       {
-        // match_found, proceed to merge.
+        // match_found, proceed to merge, unless the candidate is busy or
+        // has been merged before it could be locked.
+        if (!manager->try_lock_page(this, candidate))
+          continue;
+        if (manager->is_merged_page(this, candidate))
+        {
+          manager->unlock_page(this, candidate);
+          continue;
+        }
+
         MemoryFlags flags = Spmm::Memory::F::MERGE_VOLATILE;
         long error = manager->merge_pages(this, candidate, page, flags);
         if (error != L4_EOK)
+        {
+          manager->unlock_page(this, candidate);
           return !successful;
+        }
 
         // merge was successful, update immutable and volatile lists.
+        {
+          std::lock_guard<std::mutex> const lock(_mutex);
+          _immutable_pages.push_back({page, candidate});
+        }
+        manager->unlock_page(this, candidate);
         _volatile_pages.erase(candidate);
         _volatile_pages.erase(page);
-        _immutable_pages.push_back({page, candidate});
+        _page_ages.erase(candidate);
+        _page_ages.erase(page);
 
         return successful;
       }
@@ -120,17 +259,100 @@ private:
     return !successful;
   }
 
-  unsigned long _get_current_time_in_ms(void)
+  bool _is_mature(page_t page, checksum_t checksum)
   {
-    typedef std::chrono::high_resolution_clock hrclock;
-    typedef std::chrono::time_point<std::chrono::high_resolution_clock> tp_t;
-    typedef std::chrono::milliseconds to_ms;
-    unsigned long ms;
+    Policy const *policy = manager->get_policy(this, page);
+    if (!policy || !policy->min_age)
+      return true;
 
-    tp_t now = hrclock::now();
-    ms = std::chrono::duration_cast<to_ms>(now.time_since_epoch()).count();
+    // restart aging whenever the page content changed.
+    page_ages_t::iterator age = _page_ages.find(page);
+    if (age == _page_ages.end() || age->second.checksum != checksum)
+    {
+      _page_ages[page] = {checksum, 0};
+      return false;
+    }
 
-    return ms;
+    age->second.scans++;
+    return age->second.scans >= policy->min_age;
+  }
+
+  void _scan_page(page_t page, bool written)
+  {
+    manager->lock_page(this, page);
+
+    // honour the merge policy of the client.
+    if (!manager->may_merge_page(this, page))
+    {
+      manager->unlock_page(this, page);
+      return;
+    }
+
+    // skip pages that have been merged in the meantime (e.g. discarded,
+    // loaded or prioritised twice). they have to age again once they are
+    // unmerged.
+    if (manager->is_merged_page(this, page))
+    {
+      _volatile_pages.erase(page);
+      _page_ages.erase(page);
+      manager->unlock_page(this, page);
+      return;
+    }
+
+    // a page that has been written to since the last pass is volatile and
+    // no merge candidate. forget about it without looking at its content.
+    // this also restarts its aging.
+    if (written)
+    {
+      _volatile_pages.erase(page);
+      _page_ages.erase(page);
+      manager->unlock_page(this, page);
+      return;
+    }
+
+    // calculate checksum.
+    checksum_t checksum = _calculate_checksum(page);
+
+    // the client might require the page to be unchanged for a while.
+    if (!_is_mature(page, checksum))
+    {
+      manager->unlock_page(this, page);
+      return;
+    }
+
+    // first try immutable pages.
+    bool successful;
+    successful = _try_immutable_pages(page);
+    if (successful)
+    {
+      manager->unlock_page(this, page);
+      return;
+    }
+
+    // primitive thrashing protection.
+    checksum_t old_checksum = _volatile_pages[page];
+    bool is_zero_page_or_new = (old_checksum == 0);
+    bool checksums_match = (old_checksum == checksum);
+    bool is_stable = is_zero_page_or_new || checksums_match;
+    if (!is_stable)
+    {
+      // update checksum.
+      _volatile_pages[page] = checksum;
+      manager->unlock_page(this, page);
+      return;
+    }
+
+    // then try volatile pages.
+    successful = _try_volatile_pages(page);
+    if (successful)
+    {
+      manager->unlock_page(this, page);
+      return;
+    }
+
+    // else remember page and then checksum for later.
+    _volatile_pages[page] = checksum;
+    manager->unlock_page(this, page);
   }
 
 public:
@@ -139,67 +361,47 @@ public:
 
   void run(void) override
   {
-    printf("worker spawn @%lu\n", _get_current_time_in_ms());
+    manager->trace_event(this, L4SPMM_TRACE_WORKER_SPAWN);
     l4_sleep(60000);
-    _immutable_pages.clear();
+    // immutable pages are kept, they might stem from loaded pages already.
     _volatile_pages.clear();
 
     while(1)
     {
       //pass.
-      printf("worker scan @%lu\n", _get_current_time_in_ms());
-      for (unsigned int i = 0; i < _pages_to_scan; i++)
+      manager->trace_event(this, L4SPMM_TRACE_WORKER_SCAN, _pages_to_scan);
+      l4_uint64_t scanned = 0;
+      while (scanned < _pages_to_scan)
       {
-        // obtain next page from queue.
-        page_t page = manager->get_next_page(this);
-
-        // sanitize.
-        if (!page)
-          break;
-
-        manager->lock_page(this, page);
-
-        // first try immutable pages.
-        bool successful;
-        successful = _try_immutable_pages(page);
-        if (successful)
+        // obtain next batch of pages from queue.
+        page_t pages[VolatilityTracker::Batch_size];
+        unsigned num = 0;
+        while (num < VolatilityTracker::Batch_size
+               && scanned + num < _pages_to_scan)
         {
-          manager->unlock_page(this, page);
-          continue; // with next page.
+          page_t page = manager->get_next_page(this);
+          // sanitize.
+          if (!page)
+            break;
+          pages[num++] = page;
         }
+        scanned += num;
 
-        // calculate checksum
-        checksum_t checksum = _calculate_checksum(page);
+        if (!num)
+          break;
 
-        // primitive thrashing protection.
-        checksum_t old_checksum = _volatile_pages[page];
-        bool is_zero_page_or_new = (old_checksum == 0);
-        bool checksums_match = (old_checksum == checksum);
-        bool is_stable = is_zero_page_or_new || checksums_match;
-        if (!is_stable)
-        {
-          // update checksum.
-          _volatile_pages[page] = checksum;
-          manager->unlock_page(this, page);
-          continue; // with next page.
-        }
+        // ask the kernel which pages were written to since the last pass.
+        bool written[VolatilityTracker::Batch_size];
+        _tracker.harvest(pages, num, written);
 
-        // then try volatile pages.
-        successful = _try_volatile_pages(page);
-        if (successful)
-        {
-          manager->unlock_page(this, page);
-          continue; // with next page.
-        }
-
-        // else remember page and then checksum for later.
-        _volatile_pages[page] = checksum;
-        manager->unlock_page(this, page);
-        // and continue with next page.
+        for (unsigned i = 0; i < num; i++)
+          _scan_page(pages[i], written[i]);
       }
 
+      _tracker.end_pass();
+
       //sleep.
-      printf("worker sleep @%lu\n", _get_current_time_in_ms());
+      manager->trace_event(this, L4SPMM_TRACE_WORKER_SLEEP, scanned);
       l4_sleep(_sleep_duration);
       _volatile_pages.clear();
     }
@@ -207,6 +409,7 @@ public:
 
   bool page_unmerge_notification(page_t page) override
   {
+    std::lock_guard<std::mutex> const lock(_mutex);
     immutable_pages_t::value_type::iterator candidate;
 
     // iterate over every list in immutable pages.
@@ -234,7 +437,10 @@ public:
       // in this case, the underlying physical memory page can be freed.
       bool freeable = list.empty();
       if (freeable)
+      {
+        _drop_loaded_pages(&list);
         _immutable_pages.remove(list);
+      }
       return freeable;
     }
     // fallthrough.
@@ -242,6 +448,99 @@ public:
     //chksys(-L4_EINVAL, "page not known to this worker")
     return false;
   }
+
+  void page_discard_notification(page_t page) override
+  {
+    std::lock_guard<std::mutex> const lock(_mutex);
+    loaded_candidates_t::iterator candidate = _loaded_candidates.find(page);
+    if (candidate == _loaded_candidates.end())
+      return;
+
+    // the pages merged with a discarded candidate remain candidates for later
+    // loaded pages.
+    loaded_pages_t::iterator loaded = _loaded_pages.find(candidate->second);
+    if (loaded != _loaded_pages.end() && loaded->second.merged)
+      _set_loaded_candidate(loaded->first, 0);
+    else
+    {
+      _loaded_candidates.erase(candidate);
+      if (loaded != _loaded_pages.end())
+        _loaded_pages.erase(loaded);
+    }
+  }
+
+  bool merge_loaded_page(page_t page, l4_uint64_t source,
+                         l4_addr_t offset) override
+  {
+    bool const successful = true;
+    loaded_source_t const key = {source, offset};
+    manager->set_content_class(this, page, Spmm::Stats::Class_loaded);
+
+    // note that the volatile pages and page ages belong to the worker thread.
+    // the worker forgets about the page once it finds it merged.
+    if (!manager->may_merge_page(this, page)
+        || manager->is_merged_page(this, page))
+      return !successful;
+
+    page_t candidate = 0;
+    page_t representative = 0;
+    {
+      std::lock_guard<std::mutex> const lock(_mutex);
+      loaded_page_t &loaded = _loaded_pages[key];
+      if (loaded.merged)
+        representative = loaded.merged->front();
+      else if (!loaded.page)
+      {
+        // the first page loaded from there becomes the merge candidate.
+        _set_loaded_candidate(key, page);
+        return !successful;
+      }
+      candidate = loaded.page;
+    }
+
+    // busy pages are skipped, the worker comes across the page later on.
+    if (representative)
+    {
+      // merge with the immutable page of the earlier loaded pages. the
+      // kernel refuses, if the page has been changed after loading.
+      if (!manager->try_lock_page(this, representative))
+        return !successful;
+      long error = _merge_with_list(representative, page);
+      manager->unlock_page(this, representative);
+      return error == L4_EOK;
+    }
+
+    if (candidate == page || !manager->try_lock_page(this, candidate))
+      return !successful;
+
+    // the candidate might have been changed or merged by a scan in the
+    // meantime. the page takes its place then.
+    bool same_client = manager->get_client(this, candidate)
+                       == manager->get_client(this, page);
+    if (!manager->may_merge_page(this, candidate, same_client ? 2 : 1)
+        || manager->is_merged_page(this, candidate)
+        || !_page_contents_match(page, candidate))
+    {
+      manager->unlock_page(this, candidate);
+      std::lock_guard<std::mutex> const lock(_mutex);
+      _set_loaded_candidate(key, page);
+      return !successful;
+    }
+
+    MemoryFlags flags = Spmm::Memory::F::MERGE_VOLATILE;
+    long error = manager->merge_pages(this, candidate, page, flags);
+    if (error == L4_EOK)
+    {
+      std::lock_guard<std::mutex> const lock(_mutex);
+      _immutable_pages.push_back({page, candidate});
+      // another page loaded from there might have been merged meanwhile.
+      loaded_page_t &loaded = _loaded_pages[key];
+      if (!loaded.merged)
+        loaded.merged = &_immutable_pages.back();
+    }
+    manager->unlock_page(this, candidate);
+    return error == L4_EOK;
+  }
 };
 
 } //Spmm
@@ -19,6 +19,18 @@ namespace Spmm
  * full_scans     - how many times all mergable areas have been scanned.
  *
  * More sophisticated evaluation variables might be derived from those.
+ * Furthermore, statistics components are told how long it took to serve each
+ * page fault of a client.
+ *
+ * In addition to that, the pages_sharing and pages_unshared counters are
+ * tracked per client, and the merged pages are tracked per content class (see
+ * Spmm::Stats::Content_class), so that statistics components can break down
+ * which clients and which kinds of content benefit from same-page merging.
+ * Other components report the origin of pages that they know about.
+ *
+ * Statistics components may also record the individual merges, unmerges and
+ * page faults, and further events that other components report, as a trace
+ * (see l4/spmm/trace.h).
  */
 class Statistics : public Component
 {
@@ -37,28 +49,64 @@ public:
 
   /**
    * Increase the pages_sharing counter by one.
+   *
+   * @param page      The page that started sharing.
+   * @param imm_page  The immutable page that is shared.
    */
-  virtual void inc_pages_sharing(void) = 0;
+  virtual void inc_pages_sharing(page_t page, page_t imm_page) = 0;
 
   /**
    * Decrease the pages_sharing counter by one.
+   *
+   * @param page      The page that stopped sharing.
+   * @param imm_page  The immutable page that was shared.
    */
-  virtual void dec_pages_sharing(void) = 0;
+  virtual void dec_pages_sharing(page_t page, page_t imm_page) = 0;
 
   /**
    * Increase the pages_unshared counter by one.
+   *
+   * @param page  The page that became volatile.
    */
-  virtual void inc_pages_unshared(void) = 0;
+  virtual void inc_pages_unshared(page_t page) = 0;
 
   /**
    * Decrease the pages_unshared counter by one.
+   *
+   * @param page  The page that is no longer volatile.
    */
-  virtual void dec_pages_unshared(void) = 0;
+  virtual void dec_pages_unshared(page_t page) = 0;
 
   /**
    * Increase the full_scans counter by one.
    */
   virtual void inc_full_scans(void) = 0;
+
+  /**
+   * Report the origin of the content of a page before it gets merged.
+   *
+   * @param page  The page of interest.
+   * @param cls   Content class of the page, see Spmm::Stats::Content_class.
+   */
+  virtual void set_content_class(page_t page, unsigned cls) = 0;
+
+  /**
+   * Account a page fault of a client that has been served.
+   *
+   * @param client      The client that caused the page fault.
+   * @param latency_us  Time it took to serve the page fault, in microseconds.
+   */
+  virtual void add_fault(client_t client, l4_uint64_t latency_us) = 0;
+
+  /**
+   * Record an event that does not affect any counter in the trace.
+   *
+   * @param type  Type of the event, see l4spmm_trace_event_type.
+   * @param arg0  First argument of the event.
+   * @param arg1  Second argument of the event.
+   */
+  virtual void trace_event(l4spmm_trace_event_type type, l4_uint64_t arg0,
+                           l4_uint64_t arg1) = 0;
 };
 
 } //Spmm
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <l4/re/env>
+#include <l4/re/error_helper>
+#include <l4/re/util/cap_alloc>
+#include <l4/spmm/trace.h>
+#include <l4/sys/kip.h>
+
+#include <pthread.h>
+
+#include <atomic>
+#include <cstdio>
+
+#include "manager.h"
+
+using L4Re::chkcap;
+using L4Re::chksys;
+
+namespace Spmm
+{
+
+// a helper class that records binary trace events into a dataspace (see
+// l4/spmm/trace.h), so that a reader can drain them over shared memory.
+//
+// every thread that records events claims a ring of its own on its first
+// event, so recording an event takes neither a lock nor an IPC. threads beyond
+// the number of rings do not record any events.
+class TraceBuffer
+{
+  enum
+  {
+    Max_rings = 16,
+    // events per ring, a power of two.
+    Ring_size = 2048,
+  };
+
+private:
+  L4::Cap<L4Re::Dataspace> _ds_cap;
+  l4spmm_trace_t *_trace;
+  // threads that own the rings, 0 for unclaimed rings.
+  std::atomic<pthread_t> _owners[Max_rings];
+
+  l4spmm_trace_ring_t *_claim_ring(void)
+  {
+    pthread_t const self = pthread_self();
+    for (unsigned i = 0; i < Max_rings; i++)
+    {
+      pthread_t owner = _owners[i].load(std::memory_order_relaxed);
+      if (owner == self)
+        return l4spmm_trace_ring(_trace, i);
+      if (!owner && _owners[i].compare_exchange_strong(owner, self))
+        return l4spmm_trace_ring(_trace, i);
+    }
+    // fallthrough.
+    return nullptr;
+  }
+
+public:
+  TraceBuffer()
+  {
+    l4_size_t ring_stride = sizeof(l4spmm_trace_ring_t)
+                            + Ring_size * sizeof(l4spmm_trace_event_t);
+    l4_size_t size = l4_round_page(sizeof(l4spmm_trace_t)
+                                   + Max_rings * ring_stride);
+
+    L4Re::Env const *env = L4Re::Env::env();
+    _ds_cap = chkcap(L4Re::Util::cap_alloc.alloc<L4Re::Dataspace>(),
+                     "trace cap alloc");
+    chksys(env->mem_alloc()->alloc(size, _ds_cap), "trace mem alloc");
+
+    l4_addr_t addr = 0;
+    L4Re::Rm::Flags rm_flags = L4Re::Rm::F::RW | L4Re::Rm::F::Search_addr
+                               | L4Re::Rm::F::Eager_map;
+    chksys(env->rm()->attach(&addr, size, rm_flags,
+                             L4::Ipc::make_cap_rw(_ds_cap)),
+           "trace as attach");
+
+    // the dataspace is zero-filled, so every ring starts out empty.
+    _trace = reinterpret_cast<l4spmm_trace_t *>(addr);
+    _trace->magic       = L4SPMM_TRACE_MAGIC;
+    _trace->version     = L4SPMM_TRACE_VERSION;
+    _trace->max_rings   = Max_rings;
+    _trace->ring_size   = Ring_size;
+    _trace->ring_offset = sizeof(l4spmm_trace_t);
+    _trace->ring_stride = ring_stride;
+
+    for (std::atomic<pthread_t> &owner : _owners)
+      owner = 0;
+
+    printf("initialised trace buffer [addr: 0x%08lX, size: %ld bytes]\n",
+           addr, size);
+  }
+
+  TraceBuffer(TraceBuffer const &tb) = delete;
+
+  /**
+   * The dataspace that holds the trace buffer.
+   */
+  L4::Cap<L4Re::Dataspace> dataspace(void) const { return _ds_cap; }
+
+  /**
+   * Record an event in the ring of the calling thread.
+   *
+   * @param type    Type of the event, see l4spmm_trace_event_type.
+   * @param client  Client the event belongs to, or invalid_client.
+   * @param arg0    First argument of the event.
+   * @param arg1    Second argument of the event.
+   */
+  void record(l4spmm_trace_event_type type, client_t client,
+              l4_uint64_t arg0 = 0, l4_uint64_t arg1 = 0)
+  {
+    l4spmm_trace_ring_t *ring = _claim_ring();
+    if (!ring)
+      return;
+
+    // only this thread writes head and dropped, the reader writes tail.
+    l4_uint64_t head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= Ring_size)
+    {
+      __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+      return;
+    }
+
+    l4spmm_trace_event_t *event;
+    event = &l4spmm_trace_events(ring)[head & (Ring_size - 1)];
+    event->time   = l4_kip_clock_ns(l4re_kip());
+    event->type   = type;
+    event->client = client;
+    event->arg0   = arg0;
+    event->arg1   = arg1;
+
+    // publish the event to the reader.
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  }
+};
+
+} //Spmm
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <l4/re/env>
+#include <l4/re/error_helper>
+#include <l4/sys/task>
+#include <l4/sys/utcb.h>
+
+#include "manager.h"
+
+using L4Re::chksys;
+
+namespace Spmm
+{
+
+// a simple helper class that tells whether clients wrote to pages since the
+// previous query, without reading the content of the pages.
+//
+// idea:
+//
+// - the kernel keeps track of the accessed and dirty bits of every mapping in
+//   the page tables of the clients.
+// - an unmap operation that revokes no rights at all (status-only) reports
+//   and resets these bits for every child mapping of a page in the returned
+//   flexpage rights (R = accessed, W = dirty).
+// - query a whole batch of pages with a single unmap_batch() operation.
+//
+// only a reported dirty bit carries information: not every platform reports
+// access flags (e.g. the ARM page tables and EPT do not track them), and a
+// dirty bit that is reset without flushing the TLB might not be set again on
+// the next write. a page without a dirty bit is therefore not known to be
+// unchanged. the tracker stops querying the kernel after a pass in which no
+// page reported any flag, and probes again every Probe_passes passes.
+class VolatilityTracker
+{
+public:
+  enum
+  {
+    /// maximum number of pages per query.
+    Batch_size = L4_UTCB_GENERIC_DATA_SIZE - 2,
+    /// number of passes after which a disabled tracker probes the kernel.
+    Probe_passes = 16,
+  };
+
+private:
+  // whether the kernel is queried in the current pass.
+  bool _enabled = true;
+  // whether any page reported an access flag in the current pass.
+  bool _reported = false;
+  unsigned _passes_disabled = 0;
+
+public:
+  /**
+   * Query and reset the dirty state of a batch of pages.
+   *
+   * @param      pages    The pages of interest.
+   * @param      num      Number of pages, at most Batch_size.
+   * @param[out] written  For every page, whether it is known to have been
+   *                      written to by a client since the previous query.
+   *                      A page that is not known to have been written to
+   *                      might have been written to nevertheless.
+   */
+  void harvest(page_t const *pages, unsigned num, bool *written)
+  {
+    for (unsigned i = 0; i < num; i++)
+      written[i] = false;
+
+    if (!_enabled)
+      return;
+
+    l4_fpage_t fpages[Batch_size];
+    for (unsigned i = 0; i < num; i++)
+      fpages[i] = l4_fpage(pages[i], L4_LOG2_PAGESIZE, 0);
+
+    // the kernel returns the flexpages with the collected access flags in the
+    // message registers.
+    L4::Cap<L4::Task> const task = L4Re::Env::env()->task();
+    chksys(task->unmap_batch(fpages, num, L4_FP_OTHER_SPACES),
+           "harvest dirty state");
+
+    l4_msg_regs_t const *mr = l4_utcb_mr();
+    for (unsigned i = 0; i < num; i++)
+    {
+      l4_umword_t rights = mr->mr[2 + i] & L4_FPAGE_RIGHTS_MASK;
+      written[i] = rights & L4_FPAGE_W;
+      if (rights)
+        _reported = true;
+    }
+  }
+
+  /**
+   * Finish a pass over the pages.
+   *
+   * Decides whether the kernel is queried in the next pass.
+   */
+  void end_pass(void)
+  {
+    if (_enabled)
+      _enabled = _reported;
+    else if (++_passes_disabled >= Probe_passes)
+      _enabled = true;
+
+    if (_enabled)
+      _passes_disabled = 0;
+    _reported = false;
+  }
+};
+
+} //Spmm
@@ -42,6 +42,35 @@ public:
    * that are still mapped to the underlying physical memory page).
    */
   virtual bool page_unmerge_notification(page_t page) = 0;
+
+  /**
+   * Helper function for internal bookkeeping.
+   *
+   * @param page  The page that was discarded.
+   *
+   * Other components call this function after the content of a page has been
+   * discarded (see Spmm::Memory::discard_page), so that the worker stops
+   * keeping the page as a merge candidate.
+   */
+  virtual void page_discard_notification(page_t page) = 0;
+
+  /**
+   * Merge a page that was loaded from a known source right away.
+   *
+   * @param page    The page, locked by the caller.
+   * @param source  Identifier of the source that the page content was loaded
+   *                from (e.g. a boot module).
+   * @param offset  Offset of the page content within the source.
+   *
+   * @returns       True if the page has been merged.
+   *
+   * Pages that were loaded from the same offset of the same source are likely
+   * to have the same content, so they can be merged without waiting for a
+   * scan. The worker remembers the first such page and merges later ones with
+   * it, provided that the contents still match.
+   */
+  virtual bool merge_loaded_page(page_t page, l4_uint64_t source,
+                                 l4_addr_t offset) = 0;
 };
 
 } //Spmm